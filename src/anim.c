@@ -1,3 +1,7 @@
+#ifdef ANIM_PROFILE
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#endif
+
 #include "anim.h"
 
 #include <glib.h>
@@ -5,6 +9,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#ifdef ANIM_PROFILE
+#include <time.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ANIM_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
 /* utilities */
 
@@ -18,792 +30,5537 @@ void assert_rangei(int x, int bottom, int top) {
     g_assert_cmpint(x, <=, top);
 }
 
-/* animation runners */
-
-struct AnimationRunnerStruct {
-    Animation* animation;
-    float duration;
-    GTimeVal start_time;
-};
+/* the vector instructions this cpu supports, which choose the kernels of each kind.  the cpu is probed on first use,
+ * which may be from several threads at once */
 
-AnimationRunner* animation_runner(Animation* a) {
-    AnimationRunner* r = malloc(sizeof(AnimationRunner));
-    r->animation          = a;
-    r->duration           = animation_duration(a);
-    r->start_time.tv_sec  = 0;
-    r->start_time.tv_usec = 0;
-    return r;
-}
+typedef enum {
+    CPU_SCALAR,
+    CPU_SSE2,
+    CPU_AVX2,
+    CPU_LEVELS
+} CpuLevel;
 
-void animation_runner_start(AnimationRunner* r) {
-    g_get_current_time(&r->start_time);
-}
+CpuLevel cpu_level() {
+    static gsize level = 0;    /* the level plus one, once probed */
 
-gboolean animation_runner_update(AnimationRunner* r) {
-    GTimeVal now;
-    g_get_current_time(&now);
+    if (g_once_init_enter(&level)) {
+        CpuLevel l = CPU_SCALAR;
 
-    float t = ((float)(now.tv_sec - r->start_time.tv_sec)) + (((float)(now.tv_usec - r->start_time.tv_usec)) / (float)G_USEC_PER_SEC);
+#ifdef ANIM_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            l = CPU_AVX2;
+        else if (__builtin_cpu_supports("sse2"))
+            l = CPU_SSE2;
+#endif
 
-    if (t < r->duration) {
-        animation_update(r->animation, t);
-        return TRUE;
-    } else {
-        animation_update(r->animation, r->duration);
-        return FALSE;
+        g_once_init_leave(&level, l + 1);
     }
+
+    return level - 1;
 }
 
-void animation_runner_free(AnimationRunner* r) {
-    animation_free(r->animation);
-    free(r);
+/* 32-byte aligned blocks, for data the vector kernels stream through */
+
+void* animation_aligned_alloc(size_t size) {
+    char* p = malloc(size + 32 + sizeof(void*));
+    char* block = (char*)(((size_t)(p + sizeof(void*) + 31)) & ~(size_t)31);
+    ((void**)block)[-1] = p;
+    return block;
 }
 
-/* time transformations - modify the relationship between external time and animation time by transforming numbers in the range [0,1] */
+void animation_aligned_free(void* block) {
+    if (block != NULL)
+        free(((void**)block)[-1]);
+}
 
-typedef float (*TimeTransformFunction)(TimeTransform*, float);
+/* arenas - while an arena is pushed, nodes and the memory they own are bump-allocated from its blocks.  nodes record
+ * their arena, and their free functions never run: the arena releases everything at once.  heap memory handed to a
+ * constructor while an arena is pushed (the arrays passed to linearf, or heap-allocated children) is adopted by the
+ * arena and released along with it.  each thread has its own stack of pushed arenas, and an arena may be pushed on one
+ * thread at a time.
+ */
 
-struct TimeTransformStruct {
-    TimeTransformFunction f;
+#define ARENA_DEFAULT_BLOCK_SIZE 65536
+
+typedef void (*AdoptedFreeFunction)(void*);
+
+typedef struct ArenaBlockStruct {
+    struct ArenaBlockStruct* next;
+    size_t size, used;
+} ArenaBlock;
+
+typedef struct AdoptedStruct {
+    AdoptedFreeFunction free;
+    void* p;
+} Adopted;
+
+struct AnimationArenaStruct {
+    size_t block_size;
+    ArenaBlock* blocks;          /* the newest first */
+    GArray* adopted;
+    AnimationArena* previous;    /* the arena that was current when this one was pushed */
 };
 
-float apply_transform(TimeTransform* t, float f) {
-    g_assert(t != NULL);
-    assert_rangef(f, 0.0, 1.0);
-    return t->f(t, f);
-}
+static GPrivate current_arena_key = G_PRIVATE_INIT(NULL);
 
-/* identity transform */
+/* the arena on top of this thread's stack */
+AnimationArena* current_arena() {
+    return g_private_get(&current_arena_key);
+}
 
-float identity_transform_function(TimeTransform* t, float f) {
-    return f;
+void set_current_arena(AnimationArena* arena) {
+    g_private_set(&current_arena_key, arena);
 }
 
-TimeTransform* identity_transform() {
-    TimeTransform* t = malloc(sizeof(TimeTransform));
-    t->f = identity_transform_function;
-    return t;
+AnimationArena* animation_arena_new(size_t block_size) {
+    AnimationArena* arena = malloc(sizeof(AnimationArena));
+    arena->block_size = (block_size > 0) ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->blocks     = NULL;
+    arena->adopted    = g_array_new(FALSE, FALSE, sizeof(Adopted));
+    arena->previous   = NULL;
+    return arena;
 }
 
-/* sinusoid transform */
+void animation_arena_push(AnimationArena* arena) {
+    g_assert(arena != NULL);
 
-float sinusoid_transform_function(TimeTransform* t, float f) {
-    return (1.0 + sin((f * G_PI) - G_PI_2)) / 2.0;
+    /* pushing an arena already on the stack would link it to itself, and popping it would never get past it */
+    AnimationArena* a;
+    for (a=current_arena(); a!=NULL; a=a->previous)
+        g_assert(a != arena);
+
+    arena->previous = current_arena();
+    set_current_arena(arena);
 }
 
-TimeTransform* sinusoid_transform() {
-    TimeTransform* t = malloc(sizeof(TimeTransform));
-    t->f = sinusoid_transform_function;
-    return t;
+void animation_arena_pop() {
+    g_assert(current_arena() != NULL);
+    set_current_arena(current_arena()->previous);
 }
 
-/* reverse transform */
+void animation_arena_free(AnimationArena* arena) {
+    g_assert(arena != NULL);
+    g_assert(arena != current_arena());
 
-float reverse_transform_function(TimeTransform* t, float f) {
-    return 1.0 - f;
-}
+    int i;
+    for (i=0; i<arena->adopted->len; i++) {
+        Adopted* adopted = &g_array_index(arena->adopted, Adopted, i);
+        adopted->free(adopted->p);
+    }
+    g_array_free(arena->adopted, TRUE);
 
-TimeTransform* reverse_transform() {
-    TimeTransform* t = malloc(sizeof(TimeTransform));
-    t->f = reverse_transform_function;
-    return t;
+    while (arena->blocks != NULL) {
+        ArenaBlock* next = arena->blocks->next;
+        animation_aligned_free(arena->blocks);
+        arena->blocks = next;
+    }
+
+    free(arena);
 }
 
-/* exponent transform */
+/* blocks are 32-byte aligned, so an offset aligned within a block is an aligned address */
+void* arena_alloc(AnimationArena* arena, size_t size, size_t alignment) {
+    ArenaBlock* b = arena->blocks;
+    size_t header = (sizeof(ArenaBlock) + 31) & ~(size_t)31;
+
+    if (b == NULL || ((b->used + alignment - 1) & ~(alignment - 1)) + size > b->size) {
+        size_t block_size = (size + header > arena->block_size) ? size + header : arena->block_size;
+        b = animation_aligned_alloc(block_size);
+        b->size = block_size;
+        b->used = header;
+        b->next = arena->blocks;
+        arena->blocks = b;
+    }
 
-typedef struct exponentTransformStruct {
-    TimeTransform t;
-    float exponent;
-} exponentTransform;
+    b->used = (b->used + alignment - 1) & ~(alignment - 1);
+    void* p = (char*)b + b->used;
+    b->used += size;
 
-float exponent_transform_function(TimeTransform* t, float f) {
-    exponentTransform* e = (exponentTransform*)t;
-    return pow(f, e->exponent);
+    g_assert_cmpuint((size_t)p % alignment, ==, 0);
+    return p;
 }
 
-TimeTransform* exponent_transform(float exponent) {
-    exponentTransform* t = malloc(sizeof(exponentTransform));
-    t->t.f = exponent_transform_function;
-    t->exponent = exponent;
-    return (TimeTransform*)t;
+/* memory for a node or the data it owns: from the current arena, if there is one, and the heap otherwise */
+void* animation_alloc(size_t size) {
+    AnimationArena* arena = current_arena();
+    return arena ? arena_alloc(arena, size, 16) : malloc(size);
 }
 
-/* animations */
+void* animation_alloc_aligned(size_t size) {
+    AnimationArena* arena = current_arena();
+    return arena ? arena_alloc(arena, size, 32) : animation_aligned_alloc(size);
+}
 
-typedef void (*UpdateAnimationFunction)(Animation*, float f);
-typedef float (*AnimationDurationFunction)(Animation*);
-typedef void (*FreeAnimationFunction)(Animation*);
+/* hand heap memory passed to a constructor to the current arena, if there is one */
+void animation_adopt(void* p, AdoptedFreeFunction f) {
+    AnimationArena* arena = current_arena();
+    if (arena != NULL && p != NULL) {
+        Adopted adopted;
+        adopted.free = f;
+        adopted.p    = p;
+        g_array_append_val(arena->adopted, adopted);
+    }
+}
 
-struct AnimationStruct {
-    UpdateAnimationFunction update;
-    AnimationDurationFunction duration;
-    FreeAnimationFunction free;
-};
+/* animation clocks - a clock holds the time of its last tick, in seconds, which any number of runners can read */
 
-void animation_update(Animation* a, float f) {
-    g_assert(a != NULL);
-    assert_rangef(f, 0.0, animation_duration(a));
+typedef enum {
+    ANIMATION_CLOCK_MONOTONIC,
+    ANIMATION_CLOCK_MANUAL,
+    ANIMATION_CLOCK_FIXED
+} ClockMode;
 
-    a->update(a, f);
-}
+struct AnimationClockStruct {
+    ClockMode mode;
+    double now;
+    double step;    /* how far a fixed clock moves on each tick */
+};
 
-float animation_duration(Animation* a) {
-    g_assert(a != NULL);
-    return a->duration(a);
-}
+/* the clock of runners created without one.  it is never ticked: its runners query the time themselves */
+static AnimationClock default_clock = { ANIMATION_CLOCK_MONOTONIC, 0.0, 0.0 };
 
-void animation_free(Animation* a) {
-    g_assert(a != NULL);
-    a->free(a);
+double monotonic_seconds() {
+    return (double)g_get_monotonic_time() / (double)G_USEC_PER_SEC;
 }
 
-float default_animation_duration(Animation* a) {
-    return 1.0;
+AnimationClock* mk_clock(ClockMode mode, double now, double step) {
+    AnimationClock* c = malloc(sizeof(AnimationClock));
+    c->mode = mode;
+    c->now  = now;
+    c->step = step;
+    return c;
 }
 
-void default_animation_free(Animation* a) {
-    free(a);
+AnimationClock* animation_clock_monotonic() {
+    return mk_clock(ANIMATION_CLOCK_MONOTONIC, monotonic_seconds(), 0.0);
 }
 
-/* null animation */
-
-typedef struct NullAnimationStruct {
-    Animation a;
-} NullAnimation;
-
-void null_animation_update(Animation* a, float f) {
+AnimationClock* animation_clock_manual() {
+    return mk_clock(ANIMATION_CLOCK_MANUAL, 0.0, 0.0);
 }
 
-Animation* null_animation() {
-    NullAnimation* a = malloc(sizeof(NullAnimation));
-    a->a.update   = null_animation_update;
-    a->a.duration = default_animation_duration;
-    a->a.free     = default_animation_free;
-    return (Animation*)a;
+AnimationClock* animation_clock_fixed(float step) {
+    g_assert_cmpfloat(step, >, 0.0);
+    return mk_clock(ANIMATION_CLOCK_FIXED, 0.0, step);
 }
 
-/* hold animation */
+void animation_clock_tick(AnimationClock* c) {
+    g_assert(c != NULL);
+
+    switch (c->mode) {
+    case ANIMATION_CLOCK_MONOTONIC:
+        c->now = monotonic_seconds();
+        break;
+    case ANIMATION_CLOCK_FIXED:
+        c->now += c->step;
+        break;
+    case ANIMATION_CLOCK_MANUAL:
+        break;
+    }
+}
 
-Animation* holdf(float* v, int n, float* c) {
-    return linearf(v, 1, c, c);
+void animation_clock_advance(AnimationClock* c, float dt) {
+    g_assert(c != NULL);
+    g_assert_cmpint(c->mode, !=, ANIMATION_CLOCK_MONOTONIC);
+    g_assert_cmpfloat(dt, >=, 0.0);
+    c->now += dt;
 }
 
-Animation* holdi(int* v, int n, int* c) {
-    return lineari(v, 1, c, c);
+double animation_clock_time(AnimationClock* c) {
+    g_assert(c != NULL);
+    return c->now;
 }
 
-Animation* holdf1(float* v, float c) {
-    return linearf1(v, c, c);
+void animation_clock_free(AnimationClock* c) {
+    g_assert(c != NULL);
+    g_assert(c != &default_clock);
+    free(c);
 }
 
-Animation* holdi1(int* v, int c) {
-    return lineari1(v, c, c);
+/* the time runners on c see */
+double clock_now(AnimationClock* c) {
+    return (c == &default_clock) ? monotonic_seconds() : c->now;
 }
 
-/* linear animation (float) */
+/* animation runners */
 
-typedef struct LinearAnimationFStruct {
-    Animation a;
-    float* v;
-    int n;
-    float* start;
-    float* end;
-} LinearAnimationF;
+struct AnimationRunnerStruct {
+    Animation* animation;
+    float duration;
+    AnimationClock* clock;
+    double start_time;
+    int slot;             /* index in the owning scheduler, or -1 */
+};
 
-void linear_animationf_update(Animation* a, float f) {
-    LinearAnimationF* la = (LinearAnimationF*)a;
+AnimationRunner* animation_runner_with_clock(Animation* a, AnimationClock* c) {
+    g_assert(c != NULL);
 
-    int i;
-    for (i=0; i<la->n; i++)
-        la->v[i] = la->start[i] + (la->end[i] - la->start[i]) * f;
+    AnimationRunner* r = malloc(sizeof(AnimationRunner));
+    r->animation  = a;
+    r->duration   = animation_duration(a);
+    r->clock      = c;
+    r->start_time = 0.0;
+    r->slot       = -1;
+    return r;
 }
 
-void linear_animationf_free(Animation* a) {
-    LinearAnimationF* la = (LinearAnimationF*)a;
-    free(la->start);
-    free(la->end);
-    default_animation_free(a);
+AnimationRunner* animation_runner(Animation* a) {
+    return animation_runner_with_clock(a, &default_clock);
 }
 
-Animation* linearf(float* v, int n, float* start, float* end) {
-    g_assert(v != NULL);
-    g_assert(start != NULL);
-    g_assert(end != NULL);
-    g_assert_cmpint(n, >, 0);
-
-    LinearAnimationF* a = malloc(sizeof(LinearAnimationF));
-    a->a.update   = linear_animationf_update;
-    a->a.duration = default_animation_duration;
-    a->a.free     = linear_animationf_free;
-    a->v     = v;
-    a->n     = n;
-    a->start = start;
-    a->end   = end;
-    return (Animation*)a;
+void animation_runner_start(AnimationRunner* r) {
+    r->start_time = clock_now(r->clock);
 }
 
-Animation* linearf1(float* v, float start, float end) {
-    float* s = malloc(sizeof(float));
-    float* e = malloc(sizeof(float));
+gboolean animation_runner_update_at(AnimationRunner* r, double now) {
+    float t = (float)(now - r->start_time);
 
-    *s = start;
-    *e = end;
+    if (t < r->duration) {
+        animation_update(r->animation, t);
+        return TRUE;
+    } else {
+        animation_update(r->animation, r->duration);
+        return FALSE;
+    }
+}
 
-    return linearf(v, 1, s, e);
+gboolean animation_runner_update(AnimationRunner* r) {
+    return animation_runner_update_at(r, clock_now(r->clock));
 }
 
-/* linear animation (int) */
+void animation_runner_free(AnimationRunner* r) {
+    animation_free(r->animation);
+    free(r);
+}
 
-typedef struct LinearAnimationIStruct {
-    Animation a;
-    int* v;
-    int n;
-    int* start;
-    int* end;
-} LinearAnimationI;
+/* animation timelines - runners wait in a min-heap by start time, and once started move to a min-heap by end time.
+ * an update only touches the runners that have started, and finished runners are popped from the top of the end heap.
+ */
+
+typedef struct TimelineEntryStruct {
+    double key;    /* start time while pending, end time while active */
+    AnimationRunner* r;
+    AnimationCompletionFunction done;
+    void* data;
+} TimelineEntry;
+
+struct AnimationTimelineStruct {
+    AnimationClock* clock;
+    GArray* pending;
+    GArray* active;
+};
 
-void linear_animationi_update(Animation* a, float f) {
-    LinearAnimationI* la = (LinearAnimationI*)a;
+void timeline_heap_push(GArray* heap, TimelineEntry* e) {
+    g_array_append_val(heap, *e);
 
-    int i;
-    for (i=0; i<la->n; i++)
-        la->v[i] = la->start[i] + (la->end[i] - la->start[i]) * f;
+    TimelineEntry* h = (TimelineEntry*)heap->data;
+    int i = heap->len - 1;
+    while (i > 0 && h[(i-1)/2].key > h[i].key) {
+        TimelineEntry tmp = h[i];
+        h[i] = h[(i-1)/2];
+        h[(i-1)/2] = tmp;
+        i = (i-1)/2;
+    }
 }
 
-void linear_animationi_free(Animation* a) {
-    LinearAnimationI* la = (LinearAnimationI*)a;
-    free(la->start);
-    free(la->end);
-    default_animation_free(a);
-}
+TimelineEntry timeline_heap_pop(GArray* heap) {
+    TimelineEntry* h = (TimelineEntry*)heap->data;
+    TimelineEntry top = h[0];
+    int i = 0, n = heap->len - 1;
 
-Animation* lineari(int* v, int n, int* start, int* end) {
-    g_assert(v != NULL);
-    g_assert(start != NULL);
-    g_assert(end != NULL);
-    g_assert_cmpint(n, >, 0);
+    h[0] = h[n];
+    while (TRUE) {
+        int l = 2*i + 1, r = l + 1, m = i;
+        if (l < n && h[l].key < h[m].key)
+            m = l;
+        if (r < n && h[r].key < h[m].key)
+            m = r;
+        if (m == i)
+            break;
 
-    LinearAnimationI* a = malloc(sizeof(LinearAnimationI));
-    a->a.update   = linear_animationi_update;
-    a->a.duration = default_animation_duration;
-    a->a.free     = linear_animationi_free;
-    a->v     = v;
-    a->n     = n;
-    a->start = start;
-    a->end   = end;
-    return (Animation*)a;
+        TimelineEntry tmp = h[i];
+        h[i] = h[m];
+        h[m] = tmp;
+        i = m;
+    }
+
+    g_array_set_size(heap, n);
+    return top;
 }
 
-Animation* lineari1(int* v, int start, int end) {
-    int* s = malloc(sizeof(int));
-    int* e = malloc(sizeof(int));
+double timeline_now(AnimationTimeline* tl) {
+    return (tl->clock != NULL) ? tl->clock->now : monotonic_seconds();
+}
 
-    *s = start;
-    *e = end;
+AnimationTimeline* animation_timeline_new(AnimationClock* c) {
+    AnimationTimeline* tl = malloc(sizeof(AnimationTimeline));
+    tl->clock   = c;
+    tl->pending = g_array_new(FALSE, FALSE, sizeof(TimelineEntry));
+    tl->active  = g_array_new(FALSE, FALSE, sizeof(TimelineEntry));
+    return tl;
+}
 
-    return lineari(v, 1, s, e);
+void animation_timeline_add(AnimationTimeline* tl, AnimationRunner* r, float delay, AnimationCompletionFunction done, void* data) {
+    g_assert(tl != NULL);
+    g_assert(r != NULL);
+    g_assert_cmpfloat(delay, >=, 0.0);
+
+    TimelineEntry e;
+    e.key  = r->start_time = timeline_now(tl) + delay;
+    e.r    = r;
+    e.done = done;
+    e.data = data;
+    timeline_heap_push(tl->pending, &e);
 }
 
-/* bezier animation (float) */
+gboolean animation_timeline_update(AnimationTimeline* tl) {
+    g_assert(tl != NULL);
 
-typedef struct BezierAnimationFStruct {
-    Animation a;
-    float* v;
-    int n;
-    int m;
-    float** control_points;
-    float** working_storage;
-} BezierAnimationF;
+    double now = timeline_now(tl);
+    int i;
 
-void bezier_animationf_update(Animation* a, float f) {
-    BezierAnimationF* s = (BezierAnimationF*)a;
+    while (tl->pending->len > 0 && g_array_index(tl->pending, TimelineEntry, 0).key <= now) {
+        TimelineEntry e = timeline_heap_pop(tl->pending);
+        e.key = e.r->start_time + e.r->duration;
+        timeline_heap_push(tl->active, &e);
+    }
 
-    int i;
-    for (i=0; i<s->m; i++)
-        memcpy(s->working_storage[i], s->control_points[i], sizeof(float)*s->n);
+    for (i=0; i<tl->active->len; i++) {
+        TimelineEntry* e = &g_array_index(tl->active, TimelineEntry, i);
+        animation_runner_update_at(e->r, now);
+    }
 
-    int j, k;
-    for (i=s->m-1; i>=1; i--)
-        for (j=0; j<i; j++)
-            for (k=0; k<s->n; k++)
-                s->working_storage[j][k] = s->working_storage[j][k] + (s->working_storage[j+1][k] - s->working_storage[j][k]) * f;
+    /* the runners that ended were just updated to their final values */
+    while (tl->active->len > 0 && g_array_index(tl->active, TimelineEntry, 0).key <= now) {
+        TimelineEntry e = timeline_heap_pop(tl->active);
+        if (e.done != NULL)
+            e.done(e.r, e.data);
+        animation_runner_free(e.r);
+    }
 
-    memcpy(s->v, s->working_storage[0], sizeof(float)*s->n);
+    return tl->pending->len > 0 || tl->active->len > 0;
 }
 
-void bezier_animationf_free(Animation* a) {
-    BezierAnimationF* s = (BezierAnimationF*)a;
+void animation_timeline_free(AnimationTimeline* tl) {
+    g_assert(tl != NULL);
 
     int i;
-    for (i=0; i<s->m; i++) {
-        free(s->control_points[i]);
-        free(s->working_storage[i]);
-    }
+    for (i=0; i<tl->pending->len; i++)
+        animation_runner_free(g_array_index(tl->pending, TimelineEntry, i).r);
+    for (i=0; i<tl->active->len; i++)
+        animation_runner_free(g_array_index(tl->active, TimelineEntry, i).r);
+
+    g_array_free(tl->pending, TRUE);
+    g_array_free(tl->active, TRUE);
+    free(tl);
+}
 
-    free(s->control_points);
-    free(s->working_storage);
+/* animation schedulers - update many runners on a pool of threads.
+ *
+ * runners that conflict are joined into groups with union-find, and each group is updated in order by a single thread.
+ * the groups are split into one contiguous range per thread.  a thread claims chunks of its own range with an atomic
+ * add, and once its range is exhausted it claims chunks from the ranges of the others in the same way.
+ */
+
+#define SCHEDULER_CHUNK 16
+
+typedef struct SchedulerRangeStruct {
+    volatile gint next;   /* the first group not yet claimed */
+    gint end;
+    char pad[56];         /* keep each range on its own cache line */
+} SchedulerRange;
+
+typedef struct SchedulerWorkerStruct {
+    AnimationScheduler* s;
+    int index;
+    GThread* thread;
+} SchedulerWorker;
+
+typedef struct ConflictStruct {
+    AnimationRunner* r1;
+    AnimationRunner* r2;
+} Conflict;
+
+struct AnimationSchedulerStruct {
+    GPtrArray* runners;
+    GArray* conflicts;
+    gboolean dirty;          /* runners or conflicts changed since the groups were built */
+
+    int ngroups;
+    int* order;              /* runner slots, grouped */
+    int* group_starts;       /* group i is order[group_starts[i] .. group_starts[i+1]-1] */
+    gboolean* more;          /* per slot, the result of the runner's last update */
+
+    int nthreads;
+    SchedulerRange* ranges;
+    SchedulerWorker* workers;
+    double now;              /* the time of runners on the default clock, shared by all of them in a tick */
+
+    GMutex lock;
+    GCond start, done;
+    int generation;          /* incremented to start a tick */
+    int running;             /* workers still busy with the current tick */
+    gboolean quit;
+};
 
-    default_animation_free(a);
+void scheduler_work(AnimationScheduler* s, int self) {
+    int i, j, k;
+    for (k=0; k<s->nthreads; k++) {
+        SchedulerRange* r = &s->ranges[(self + k) % s->nthreads];
+
+        while (TRUE) {
+            int begin = g_atomic_int_add(&r->next, SCHEDULER_CHUNK);
+            if (begin >= r->end)
+                break;
+
+            int end = (begin + SCHEDULER_CHUNK < r->end) ? begin + SCHEDULER_CHUNK : r->end;
+            for (i=begin; i<end; i++) {
+                for (j=s->group_starts[i]; j<s->group_starts[i+1]; j++) {
+                    int slot = s->order[j];
+                    AnimationRunner* r = g_ptr_array_index(s->runners, slot);
+                    s->more[slot] = animation_runner_update_at(r, (r->clock == &default_clock) ? s->now : r->clock->now);
+                }
+            }
+        }
+    }
 }
 
-Animation* bezierf(float* v, int n, int m, float** control_points) {
-    g_assert(v != NULL);
-    g_assert(control_points != NULL);
-    g_assert_cmpint(n, >, 0);
-    g_assert_cmpint(m, >, 0);
+gpointer scheduler_thread(gpointer data) {
+    SchedulerWorker* w = data;
+    AnimationScheduler* s = w->s;
+    int seen = 0;
 
-    int i;
+    g_mutex_lock(&s->lock);
+    while (TRUE) {
+        while (s->generation == seen && !s->quit)
+            g_cond_wait(&s->start, &s->lock);
+        if (s->quit)
+            break;
+        seen = s->generation;
+        g_mutex_unlock(&s->lock);
 
-    BezierAnimationF* a = malloc(sizeof(BezierAnimationF));
-    a->a.update         = bezier_animationf_update;
-    a->a.duration       = default_animation_duration;
-    a->a.free           = bezier_animationf_free;
-    a->v               = v;
-    a->n               = n;
-    a->m               = m;
-    a->control_points  = control_points;
-    a->working_storage = malloc(sizeof(float*) * m);
-    for (i=0; i<m; i++)
-        a->working_storage[i] = malloc(sizeof(float) * n);
+        scheduler_work(s, w->index);
 
-    return (Animation*)a;
+        g_mutex_lock(&s->lock);
+        if (--s->running == 0)
+            g_cond_signal(&s->done);
+    }
+    g_mutex_unlock(&s->lock);
+
+    return NULL;
 }
 
-/* scaled animation */
+AnimationScheduler* animation_scheduler_new(int nthreads) {
+    g_assert_cmpint(nthreads, >=, 0);
+
+    AnimationScheduler* s = malloc(sizeof(AnimationScheduler));
+    s->runners      = g_ptr_array_new();
+    s->conflicts    = g_array_new(FALSE, FALSE, sizeof(Conflict));
+    s->dirty        = TRUE;
+    s->ngroups      = 0;
+    s->order        = NULL;
+    s->group_starts = NULL;
+    s->more         = NULL;
+    s->nthreads     = (nthreads > 0) ? nthreads : g_get_num_processors();
+    s->ranges       = animation_aligned_alloc(sizeof(SchedulerRange) * s->nthreads);
+    s->workers      = malloc(sizeof(SchedulerWorker) * s->nthreads);
+    s->generation   = 0;
+    s->running      = 0;
+    s->quit         = FALSE;
+
+    g_mutex_init(&s->lock);
+    g_cond_init(&s->start);
+    g_cond_init(&s->done);
+
+    /* the calling thread is worker 0 */
+    int i;
+    for (i=0; i<s->nthreads; i++) {
+        s->workers[i].s      = s;
+        s->workers[i].index  = i;
+        s->workers[i].thread = (i > 0) ? g_thread_new("animation-scheduler", scheduler_thread, &s->workers[i]) : NULL;
+    }
 
-typedef struct ScaledAnimationStruct {
-    Animation a;
-    Animation* child;
-    float scale_factor;
-} ScaledAnimation;
+    return s;
+}
 
-void scaled_animation_update(Animation* a, float f) {
-    ScaledAnimation* sa = (ScaledAnimation*)a;
-    animation_update(sa->child, f / sa->scale_factor);
+void animation_scheduler_add(AnimationScheduler* s, AnimationRunner* r) {
+    g_assert(s != NULL);
+    g_assert(r != NULL);
+    g_assert_cmpint(r->slot, ==, -1);
+
+    r->slot = s->runners->len;
+    g_ptr_array_add(s->runners, r);
+    s->dirty = TRUE;
 }
 
-void scaled_animation_free(Animation* a) {
-    ScaledAnimation* sa = (ScaledAnimation*)a;
-    animation_free(sa->child);
-    default_animation_free(a);
+void animation_scheduler_conflict(AnimationScheduler* s, AnimationRunner* r1, AnimationRunner* r2) {
+    g_assert(s != NULL);
+    g_assert(r1 != NULL && r1->slot >= 0 && g_ptr_array_index(s->runners, r1->slot) == r1);
+    g_assert(r2 != NULL && r2->slot >= 0 && g_ptr_array_index(s->runners, r2->slot) == r2);
+
+    Conflict c;
+    c.r1 = r1;
+    c.r2 = r2;
+    g_array_append_val(s->conflicts, c);
+    s->dirty = TRUE;
 }
 
-float scaled_animation_duration(Animation* a) {
-    ScaledAnimation* sa = (ScaledAnimation*)a;
-    return animation_duration(sa->child) * sa->scale_factor;
+int scheduler_find(int* parent, int i) {
+    while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+    return i;
 }
 
-Animation* scale(Animation* a, float scale_factor) {
-    g_assert(a != NULL);
-    g_assert_cmpfloat(scale_factor, !=, 0);
+/* rebuild the groups and split them into ranges */
+void scheduler_plan(AnimationScheduler* s) {
+    int i, n = s->runners->len;
 
-    ScaledAnimation* s = malloc(sizeof(ScaledAnimation));
-    s->a.update         = scaled_animation_update;
-    s->a.duration       = scaled_animation_duration;
-    s->a.free           = scaled_animation_free;
-    s->child        = a;
-    s->scale_factor = scale_factor;
-    return (Animation*)s;
-}
+    free(s->order);
+    free(s->group_starts);
+    free(s->more);
 
-/* transformed animation */
+    int* parent = malloc(sizeof(int) * (n+1));
+    int* counts = malloc(sizeof(int) * (n+1));
+    for (i=0; i<n; i++)
+        parent[i] = i;
 
-typedef struct TransformedAnimationStruct {
+    for (i=0; i<s->conflicts->len; i++) {
+        Conflict* c = &g_array_index(s->conflicts, Conflict, i);
+        int a = scheduler_find(parent, c->r1->slot), b = scheduler_find(parent, c->r2->slot);
+        if (a != b)
+            parent[a < b ? b : a] = (a < b) ? a : b;
+    }
+
+    /* number the groups by their roots, then counting-sort the slots by group */
+    for (i=0; i<n; i++)
+        counts[i] = -1;
+    s->ngroups = 0;
+    for (i=0; i<n; i++) {
+        int root = scheduler_find(parent, i);
+        if (counts[root] < 0)
+            counts[root] = s->ngroups++;
+        parent[i] = root;
+    }
+
+    s->order        = malloc(sizeof(int) * (n+1));
+    s->group_starts = calloc(s->ngroups + 1, sizeof(int));
+    s->more         = malloc(sizeof(gboolean) * (n+1));
+
+    for (i=0; i<n; i++)
+        s->group_starts[counts[parent[i]] + 1]++;
+    for (i=0; i<s->ngroups; i++)
+        s->group_starts[i+1] += s->group_starts[i];
+
+    int* fill = malloc(sizeof(int) * (s->ngroups + 1));
+    memcpy(fill, s->group_starts, sizeof(int) * (s->ngroups + 1));
+    for (i=0; i<n; i++)
+        s->order[fill[counts[parent[i]]]++] = i;
+
+    free(fill);
+    free(counts);
+    free(parent);
+
+    s->dirty = FALSE;
+}
+
+/* free finished runners, and the conflicts that mention them */
+void scheduler_compact(AnimationScheduler* s) {
+    int i, n = 0;
+
+    for (i=0; i<s->conflicts->len; i++) {
+        Conflict* c = &g_array_index(s->conflicts, Conflict, i);
+        if (s->more[c->r1->slot] && s->more[c->r2->slot])
+            g_array_index(s->conflicts, Conflict, n++) = *c;
+    }
+    g_array_set_size(s->conflicts, n);
+
+    n = 0;
+    for (i=0; i<s->runners->len; i++) {
+        AnimationRunner* r = g_ptr_array_index(s->runners, i);
+        if (s->more[i]) {
+            r->slot = n;
+            g_ptr_array_index(s->runners, n++) = r;
+        } else {
+            animation_runner_free(r);
+        }
+    }
+
+    if (n < s->runners->len) {
+        g_ptr_array_set_size(s->runners, n);
+        s->dirty = TRUE;
+    }
+}
+
+gboolean animation_scheduler_update(AnimationScheduler* s) {
+    g_assert(s != NULL);
+
+    if (s->dirty)
+        scheduler_plan(s);
+
+    int i;
+    for (i=0; i<s->nthreads; i++) {
+        s->ranges[i].next = (int)(((long)s->ngroups * i) / s->nthreads);
+        s->ranges[i].end  = (int)(((long)s->ngroups * (i+1)) / s->nthreads);
+    }
+
+    s->now = monotonic_seconds();
+
+    g_mutex_lock(&s->lock);
+    s->generation++;
+    s->running = s->nthreads - 1;
+    g_cond_broadcast(&s->start);
+    g_mutex_unlock(&s->lock);
+
+    scheduler_work(s, 0);
+
+    /* join, so that every target is written before returning */
+    g_mutex_lock(&s->lock);
+    while (s->running > 0)
+        g_cond_wait(&s->done, &s->lock);
+    g_mutex_unlock(&s->lock);
+
+    scheduler_compact(s);
+    return s->runners->len > 0;
+}
+
+void animation_scheduler_free(AnimationScheduler* s) {
+    g_assert(s != NULL);
+
+    g_mutex_lock(&s->lock);
+    s->quit = TRUE;
+    g_cond_broadcast(&s->start);
+    g_mutex_unlock(&s->lock);
+
+    int i;
+    for (i=1; i<s->nthreads; i++)
+        g_thread_join(s->workers[i].thread);
+
+    for (i=0; i<s->runners->len; i++)
+        animation_runner_free(g_ptr_array_index(s->runners, i));
+    g_ptr_array_free(s->runners, TRUE);
+    g_array_free(s->conflicts, TRUE);
+
+    g_mutex_clear(&s->lock);
+    g_cond_clear(&s->start);
+    g_cond_clear(&s->done);
+
+    free(s->order);
+    free(s->group_starts);
+    free(s->more);
+    animation_aligned_free(s->ranges);
+    free(s->workers);
+    free(s);
+}
+
+/* time transformations - modify the relationship between external time and animation time by transforming numbers in the range [0,1] */
+
+typedef float (*TimeTransformFunction)(TimeTransform*, float);
+typedef void (*FreeTimeTransformFunction)(TimeTransform*);
+
+struct TimeTransformStruct {
+    TimeTransformFunction f;
+    FreeTimeTransformFunction free;
+    AnimationArena* arena;
+};
+
+void default_time_transform_free(TimeTransform* t) {
+    free(t);
+}
+
+TimeTransform* mk_transform(size_t size, TimeTransformFunction f) {
+    TimeTransform* t = animation_alloc(size);
+    t->f     = f;
+    t->free  = default_time_transform_free;
+    t->arena = current_arena();
+    return t;
+}
+
+void time_transform_free(void* p) {
+    TimeTransform* t = p;
+    if (t->arena == NULL)
+        t->free(t);
+}
+
+float apply_transform(TimeTransform* t, float f) {
+    g_assert(t != NULL);
+    assert_rangef(f, 0.0, 1.0);
+    return t->f(t, f);
+}
+
+/* identity transform */
+
+float identity_transform_function(TimeTransform* t, float f) {
+    return f;
+}
+
+TimeTransform* identity_transform() {
+    return mk_transform(sizeof(TimeTransform), identity_transform_function);
+}
+
+/* sinusoid transform - (1 + sin(x)) / 2 for x = pi (f - 1/2), with sin(x) from its Taylor series to x^11, which is within
+ * 6e-8 of sin(x) for |x| <= pi/2.  with float rounding the result is within 1.5e-7 of the exact value (1.41e-7 at worst
+ * over every multiple of 2^-24), and exact at 0, 1/2 and 1.
+ */
+
+#define SINUSOID_PI 3.14159265358979f
+#define SINUSOID_1 -1.6666667e-1f
+#define SINUSOID_2 8.3333333e-3f
+#define SINUSOID_3 -1.9841270e-4f
+#define SINUSOID_4 2.7557319e-6f
+#define SINUSOID_5 -2.5052108e-8f
+
+float sinusoid_transform_function(TimeTransform* t, float f) {
+    if (f <= 0.0f)
+        return 0.0f;
+    if (f >= 1.0f)
+        return 1.0f;
+
+    float x = (f - 0.5f) * SINUSOID_PI, z = x * x;
+    float s = x * (1.0f + z * (SINUSOID_1 + z * (SINUSOID_2 + z * (SINUSOID_3 + z * (SINUSOID_4 + z * SINUSOID_5)))));
+    float v = 0.5f + 0.5f * s;
+
+    return (v < 0.0f) ? 0.0f : (v > 1.0f) ? 1.0f : v;
+}
+
+TimeTransform* sinusoid_transform() {
+    return mk_transform(sizeof(TimeTransform), sinusoid_transform_function);
+}
+
+/* reverse transform */
+
+float reverse_transform_function(TimeTransform* t, float f) {
+    return 1.0 - f;
+}
+
+TimeTransform* reverse_transform() {
+    return mk_transform(sizeof(TimeTransform), reverse_transform_function);
+}
+
+/* exponent transform */
+
+typedef struct exponentTransformStruct {
+    TimeTransform t;
+    float exponent;
+} exponentTransform;
+
+float exponent_transform_function(TimeTransform* t, float f) {
+    exponentTransform* e = (exponentTransform*)t;
+    return pow(f, e->exponent);
+}
+
+/* small whole exponents are computed by repeated squaring */
+#define EXPONENT_INTEGER_MAX 16
+
+float exponent_integer(float f, int n) {
+    float result = 1.0f;
+
+    while (n > 0) {
+        if (n & 1)
+            result *= f;
+        f *= f;
+        n >>= 1;
+    }
+
+    return result;
+}
+
+float exponent_transform_function_integer(TimeTransform* t, float f) {
+    exponentTransform* e = (exponentTransform*)t;
+    return exponent_integer(f, (int)e->exponent);
+}
+
+TimeTransform* exponent_transform(float exponent) {
+    gboolean integer = exponent >= 0.0 && exponent <= EXPONENT_INTEGER_MAX && exponent == (float)(int)exponent;
+    exponentTransform* t = (exponentTransform*)mk_transform(sizeof(exponentTransform), integer ? exponent_transform_function_integer : exponent_transform_function);
+    t->exponent = exponent;
+    return (TimeTransform*)t;
+}
+
+/* table transform - samples of another transform at size+1 evenly spaced points, interpolated linearly */
+
+typedef struct LutTransformStruct {
+    TimeTransform t;
+    int size;
+    float* table;    /* follows the struct in the same block */
+} LutTransform;
+
+float lut_lookup(const float* table, int size, float f) {
+    float x = f * size;
+    int i = (int)x;
+    if (i >= size)
+        i = size - 1;
+
+    return table[i] + (table[i+1] - table[i]) * (x - i);
+}
+
+float lut_transform_function(TimeTransform* t, float f) {
+    LutTransform* l = (LutTransform*)t;
+    return lut_lookup(l->table, l->size, f);
+}
+
+TimeTransform* lut_transform(TimeTransform* t, int size) {
+    g_assert(t != NULL);
+    g_assert_cmpint(size, >, 0);
+
+    LutTransform* l = (LutTransform*)mk_transform(sizeof(LutTransform) + sizeof(float) * (size+1), lut_transform_function);
+    l->size  = size;
+    l->table = (float*)(l + 1);
+
+    int i;
+    for (i=0; i<=size; i++)
+        l->table[i] = apply_transform(t, (float)i / size);
+
+    time_transform_free(t);
+    return (TimeTransform*)l;
+}
+
+/* cubic bezier transform - the css easing curve through (0,0), (x1,y1), (x2,y2) and (1,1).  f is the curve's x, and the
+ * curve's parameter s at that x is found from a table of x at evenly spaced s.  a second table gives, for each of as
+ * many evenly spaced x, the first entry of the first to look at, so the search starts next to the answer.  s is then
+ * interpolated between the entries either side, and refined with one newton step kept between them.  the result is
+ * within 5e-6 of the exact curve for the css keyword curves.
+ */
+
+#define CUBIC_BEZIER_SAMPLES 256
+
+typedef struct CubicBezierCurveStruct {
+    float ax, bx, cx;                          /* x(s) = ((ax s + bx) s + cx) s */
+    float ay, by, cy;                          /* y(s) = ((ay s + by) s + cy) s */
+    float xs[CUBIC_BEZIER_SAMPLES + 1];        /* x(i / CUBIC_BEZIER_SAMPLES) */
+    gint32 first[CUBIC_BEZIER_SAMPLES + 1];    /* the last i with xs[i] <= j / CUBIC_BEZIER_SAMPLES */
+} CubicBezierCurve;
+
+typedef struct CubicBezierTransformStruct {
+    TimeTransform t;
+    CubicBezierCurve c;
+} CubicBezierTransform;
+
+float cubic_bezier_curve(const CubicBezierCurve* cb, float f) {
+    int j = (int)(f * CUBIC_BEZIER_SAMPLES);
+    if (j > CUBIC_BEZIER_SAMPLES)
+        j = CUBIC_BEZIER_SAMPLES;
+
+    int i = cb->first[j];
+    while (i < CUBIC_BEZIER_SAMPLES - 1 && cb->xs[i+1] < f)
+        i++;
+    if (i >= CUBIC_BEZIER_SAMPLES)
+        i = CUBIC_BEZIER_SAMPLES - 1;
+
+    float lo = (float)i / CUBIC_BEZIER_SAMPLES, hi = (float)(i+1) / CUBIC_BEZIER_SAMPLES;
+    float w = cb->xs[i+1] - cb->xs[i];
+    float s = (w > 0.0f) ? lo + (hi - lo) * (f - cb->xs[i]) / w : lo;
+
+    float dx = (3.0f * cb->ax * s + 2.0f * cb->bx) * s + cb->cx;
+    if (dx > 0.0f) {
+        s -= (((cb->ax * s + cb->bx) * s + cb->cx) * s - f) / dx;
+        s = (s < lo) ? lo : (s > hi) ? hi : s;
+    }
+
+    float y = ((cb->ay * s + cb->by) * s + cb->cy) * s;
+    return (y < 0.0f) ? 0.0f : (y > 1.0f) ? 1.0f : y;
+}
+
+float cubic_bezier_transform_function(TimeTransform* t, float f) {
+    return cubic_bezier_curve(&((CubicBezierTransform*)t)->c, f);
+}
+
+TimeTransform* cubic_bezier_transform(float x1, float y1, float x2, float y2) {
+    assert_rangef(x1, 0.0, 1.0);
+    assert_rangef(y1, 0.0, 1.0);
+    assert_rangef(x2, 0.0, 1.0);
+    assert_rangef(y2, 0.0, 1.0);
+
+    CubicBezierTransform* t = (CubicBezierTransform*)mk_transform(sizeof(CubicBezierTransform), cubic_bezier_transform_function);
+    CubicBezierCurve* cb = &t->c;
+    cb->cx = 3.0 * x1;
+    cb->bx = 3.0 * (x2 - x1) - cb->cx;
+    cb->ax = 1.0 - cb->cx - cb->bx;
+    cb->cy = 3.0 * y1;
+    cb->by = 3.0 * (y2 - y1) - cb->cy;
+    cb->ay = 1.0 - cb->cy - cb->by;
+
+    /* x(s) is non-decreasing for x1 and x2 in [0, 1] */
+    int i, j;
+    for (i=0; i<=CUBIC_BEZIER_SAMPLES; i++) {
+        float s = (float)i / CUBIC_BEZIER_SAMPLES;
+        cb->xs[i] = ((cb->ax * s + cb->bx) * s + cb->cx) * s;
+    }
+    cb->xs[CUBIC_BEZIER_SAMPLES] = 1.0;
+
+    for (i=0, j=0; j<=CUBIC_BEZIER_SAMPLES; j++) {
+        while (i < CUBIC_BEZIER_SAMPLES && cb->xs[i+1] <= (float)j / CUBIC_BEZIER_SAMPLES)
+            i++;
+        cb->first[j] = i;
+    }
+
+    return (TimeTransform*)t;
+}
+
+/* chained transform - transforms applied one after another, as nested transformed animations would apply them */
+
+typedef struct ChainTransformStruct {
+    TimeTransform t;
+    int n;
+    TimeTransform** parts;    /* the outermost first.  follows the struct in the same block */
+} ChainTransform;
+
+float chain_transform_function(TimeTransform* t, float f) {
+    ChainTransform* c = (ChainTransform*)t;
+    int i;
+    for (i=0; i<c->n; i++)
+        f = c->parts[i]->f(c->parts[i], f);
+    return f;
+}
+
+void chain_transform_free(TimeTransform* t) {
+    ChainTransform* c = (ChainTransform*)t;
+    int i;
+    for (i=0; i<c->n; i++)
+        time_transform_free(c->parts[i]);
+    default_time_transform_free(t);
+}
+
+gboolean is_exponent_transform(TimeTransform* t) {
+    return t->f == exponent_transform_function || t->f == exponent_transform_function_integer;
+}
+
+/* append t to a chain of n parts, simplifying as it goes: identities are dropped, reverses cancel in pairs and
+ * exponents multiply.  t is consumed, and the new number of parts returned
+ */
+int chain_append(TimeTransform** parts, int n, TimeTransform* t) {
+    int i;
+
+    if (t->f == chain_transform_function) {
+        ChainTransform* c = (ChainTransform*)t;
+        for (i=0; i<c->n; i++)
+            n = chain_append(parts, n, c->parts[i]);
+        if (t->arena == NULL)
+            default_time_transform_free(t);
+        return n;
+    }
+
+    if (t->f == identity_transform_function || (is_exponent_transform(t) && ((exponentTransform*)t)->exponent == 1.0)) {
+        time_transform_free(t);
+        return n;
+    }
+
+    if (n > 0 && t->f == reverse_transform_function && parts[n-1]->f == reverse_transform_function) {
+        time_transform_free(parts[n-1]);
+        time_transform_free(t);
+        return n-1;
+    }
+
+    /* (f^p)^q = f^(pq) */
+    if (n > 0 && is_exponent_transform(t) && is_exponent_transform(parts[n-1])) {
+        float p = ((exponentTransform*)parts[n-1])->exponent, q = ((exponentTransform*)t)->exponent;
+        time_transform_free(parts[n-1]);
+        time_transform_free(t);
+        return chain_append(parts, n-1, exponent_transform(p * q));
+    }
+
+    parts[n] = t;
+    return n+1;
+}
+
+int chain_length(TimeTransform* t) {
+    return (t->f == chain_transform_function) ? ((ChainTransform*)t)->n : 1;
+}
+
+/* the transform that applies outer and then inner, or NULL if that is the identity.  both are consumed */
+TimeTransform* chain_transforms(TimeTransform* outer, TimeTransform* inner) {
+    TimeTransform** parts = malloc(sizeof(TimeTransform*) * (chain_length(outer) + chain_length(inner)));
+    int n = chain_append(parts, 0, outer);
+    n = chain_append(parts, n, inner);
+
+    TimeTransform* t = NULL;
+    if (n == 1) {
+        t = parts[0];
+    } else if (n > 1) {
+        ChainTransform* c = (ChainTransform*)mk_transform(sizeof(ChainTransform) + sizeof(TimeTransform*) * n, chain_transform_function);
+        c->t.free = chain_transform_free;
+        c->n      = n;
+        c->parts  = (TimeTransform**)(c + 1);
+        memcpy(c->parts, parts, sizeof(TimeTransform*) * n);
+        t = (TimeTransform*)c;
+    }
+
+    free(parts);
+    return t;
+}
+
+/* animations */
+
+typedef enum {
+    ANIMATION_NULL,
+    ANIMATION_LINEARF,
+    ANIMATION_LINEARI,
+    ANIMATION_BEZIERF,
+    ANIMATION_SPLINEF,
+    ANIMATION_KEYFRAMESF,
+    ANIMATION_SCALED,
+    ANIMATION_TRANSFORMED,
+    ANIMATION_SEQUENCE,
+    ANIMATION_FLAT_SEQUENCE,
+    ANIMATION_PARALLEL,
+    ANIMATION_DERIVED,
+    ANIMATION_COMPILED,
+    ANIMATION_BAKED,
+    ANIMATION_IMAGE
+} AnimationKind;
+
+typedef void (*UpdateAnimationFunction)(Animation*, float f);
+typedef float (*AnimationDurationFunction)(Animation*);
+typedef void (*FreeAnimationFunction)(Animation*);
+typedef void (*AnimationVisitor)(Animation*, void* data);
+typedef void (*VisitAnimationFunction)(Animation*, AnimationVisitor, void* data);
+
+/* profiling - built with ANIM_PROFILE, each node counts its updates and duration computations, and the time spent in
+ * them.  times include the node's children.  built without it, the hooks are empty and nodes carry no counters.
+ */
+
+#ifdef ANIM_PROFILE
+
+typedef struct NodeProfileStruct {
+    unsigned long calls, duration_calls;
+    double update_seconds, duration_seconds;
+} NodeProfile;
+
+double profile_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define PROFILE_RESET(a) memset(&(a)->profile, 0, sizeof(NodeProfile))
+#define PROFILE_UPDATE(a, call) do { \
+        double profile_start = profile_clock(); \
+        call; \
+        (a)->profile.calls++; \
+        (a)->profile.update_seconds += profile_clock() - profile_start; \
+    } while (0)
+#define PROFILE_DURATION(a, call) do { \
+        double profile_start = profile_clock(); \
+        call; \
+        (a)->profile.duration_calls++; \
+        (a)->profile.duration_seconds += profile_clock() - profile_start; \
+    } while (0)
+
+#else
+
+#define PROFILE_RESET(a) do { } while (0)
+#define PROFILE_UPDATE(a, call) call
+#define PROFILE_DURATION(a, call) call
+
+#endif
+
+struct AnimationStruct {
+    AnimationKind kind;
+    UpdateAnimationFunction update;
+    AnimationDurationFunction duration;
+    FreeAnimationFunction free;
+    VisitAnimationFunction visit;    /* calls the visitor on each direct child */
+    float cached_duration;           /* duration(a), computed when the node is built */
+    AnimationArena* arena;           /* the arena the node was allocated from, or NULL */
+    gboolean sealed;                 /* validated by animation_seal: children are updated without checks */
+    gboolean is_null;                /* the node writes nothing, like the null animation */
+    gboolean is_static;              /* the node writes the same values whatever the time */
+    gboolean has_static;             /* the node or one of its descendants is static */
+    gboolean written;                /* a static node has written its values, so updating it again can be skipped */
+    gboolean shared;                 /* children write some of the same values, so their static nodes are never skipped */
+#ifdef ANIM_PROFILE
+    NodeProfile profile;
+#endif
+};
+
+/* static nodes - a node is static if its output does not depend on time.  leaves say so themselves (the null animation,
+ * and linear animations that start and end at the same values).  a node with children is static if they all are, except
+ * that a sequence must also have at most one child that writes anything, as it would otherwise switch between their values.
+ * derived values read values that other nodes may write, so a node with them is never static, nor null.
+ *
+ * under a sealed parent, a static node that has written is skipped until it is marked stale.  a sequence marks a child
+ * stale as it switches to it, and a node whose children write some of the same values as each other (a parallel, or a
+ * derived node whose values overwrite its child's) marks its children stale on every update, so that each frame writes
+ * what it would unskipped.  nothing can tell when a caller writes a target between updates, so skipping is left to
+ * trees that have been sealed, and unsealed nodes write on every update as they always have.
+ */
+
+typedef struct StaticSummaryStruct {
+    int children, non_null;
+    gboolean all_null, all_static, has_static, all_written;
+} StaticSummary;
+
+void static_summary_visitor(Animation* a, void* data) {
+    StaticSummary* summary = data;
+    summary->children++;
+    summary->non_null    += !a->is_null;
+    summary->all_null    = summary->all_null && a->is_null;
+    summary->all_static  = summary->all_static && a->is_static;
+    summary->has_static  = summary->has_static || a->has_static;
+    summary->all_written = summary->all_written && a->written;
+}
+
+StaticSummary static_summary(Animation* a) {
+    StaticSummary summary;
+    summary.children    = 0;
+    summary.non_null    = 0;
+    summary.all_null    = TRUE;
+    summary.all_static  = TRUE;
+    summary.has_static  = FALSE;
+    summary.all_written = TRUE;
+    a->visit(a, static_summary_visitor, &summary);
+    return summary;
+}
+
+gboolean animation_shares_targets(Animation* a);
+
+void animation_init_static(Animation* a) {
+    StaticSummary summary = static_summary(a);
+
+    if (summary.children > 0) {
+        a->is_null   = summary.all_null;
+        a->is_static = summary.all_static;
+        if (a->kind == ANIMATION_SEQUENCE || a->kind == ANIMATION_FLAT_SEQUENCE)
+            a->is_static = a->is_static && summary.non_null <= 1;
+    }
+
+    if (a->kind == ANIMATION_DERIVED) {
+        a->is_null   = FALSE;
+        a->is_static = FALSE;
+    }
+
+    a->has_static = a->is_static || summary.has_static;
+    a->shared     = summary.has_static && animation_shares_targets(a);
+}
+
+/* for leaves that find themselves static once built */
+void animation_set_static(Animation* a) {
+    a->is_static  = TRUE;
+    a->has_static = TRUE;
+}
+
+void animation_mark_stale(Animation* a);
+
+void animation_mark_stale_visitor(Animation* a, void* data) {
+    animation_mark_stale(a);
+}
+
+/* forget that a subtree's static nodes have written their values, because something else may have overwritten them */
+void animation_mark_stale(Animation* a) {
+    if (!a->has_static)
+        return;
+
+    a->written = a->is_null;
+    a->visit(a, animation_mark_stale_visitor, NULL);
+}
+
+/* must be called once the node's children are in place, as it computes the node's duration */
+void animation_init(Animation* a, AnimationKind kind, UpdateAnimationFunction update, AnimationDurationFunction duration, FreeAnimationFunction free, VisitAnimationFunction visit) {
+    a->kind            = kind;
+    a->update          = update;
+    a->duration        = duration;
+    a->free            = free;
+    a->visit           = visit;
+    a->arena           = current_arena();
+    a->sealed          = FALSE;
+    a->is_null         = (kind == ANIMATION_NULL);
+    a->is_static       = (kind == ANIMATION_NULL);
+    PROFILE_RESET(a);
+    PROFILE_DURATION(a, a->cached_duration = duration(a));
+    animation_init_static(a);
+    a->written         = a->is_null;
+}
+
+void animation_update(Animation* a, float f) {
+    g_assert(a != NULL);
+    assert_rangef(f, 0.0, animation_duration(a));
+
+    PROFILE_UPDATE(a, a->update(a, f));
+}
+
+/* used by nodes to update their children.  the times a sealed parent passes on were validated when it was sealed, but
+ * a sealed child under an unsealed parent is given times nothing has checked */
+void animation_update_child(Animation* parent, Animation* a, float f) {
+    if (!parent->sealed) {
+        animation_update(a, f);
+        return;
+    }
+
+    if (a->written)
+        return;
+
+    PROFILE_UPDATE(a, a->update(a, f));
+
+    /* a static node is done once each of its children is, which for a sequence may take several updates */
+    if (a->is_static)
+        a->written = static_summary(a).all_written;
+}
+
+float animation_duration(Animation* a) {
+    g_assert(a != NULL);
+    return a->cached_duration;
+}
+
+void animation_invalidate_visitor(Animation* a, void* data) {
+    animation_invalidate(a);
+}
+
+void animation_invalidate(Animation* a) {
+    g_assert(a != NULL);
+    a->visit(a, animation_invalidate_visitor, NULL);
+    PROFILE_DURATION(a, a->cached_duration = a->duration(a));
+    a->sealed = FALSE;
+    animation_init_static(a);
+    animation_mark_stale(a);
+}
+
+void animation_free(Animation* a) {
+    g_assert(a != NULL);
+
+    /* released with its arena */
+    if (a->arena != NULL)
+        return;
+
+    a->free(a);
+}
+
+void animation_free_adopted(void* a) {
+    animation_free(a);
+}
+
+/* called by constructors on each child, so that an arena node does not leak a heap child */
+void animation_adopt_child(Animation* child) {
+    if (child->arena == NULL)
+        animation_adopt(child, animation_free_adopted);
+}
+
+float default_animation_duration(Animation* a) {
+    return 1.0;
+}
+
+void default_animation_free(Animation* a) {
+    free(a);
+}
+
+void default_animation_visit(Animation* a, AnimationVisitor visitor, void* data) {
+}
+
+/* null animation */
+
+typedef struct NullAnimationStruct {
+    Animation a;
+} NullAnimation;
+
+void null_animation_update(Animation* a, float f) {
+}
+
+Animation* null_animation() {
+    NullAnimation* a = animation_alloc(sizeof(NullAnimation));
+    animation_init(&a->a, ANIMATION_NULL, null_animation_update, default_animation_duration, default_animation_free, default_animation_visit);
+    return (Animation*)a;
+}
+
+/* hold animation */
+
+Animation* holdf(float* v, int n, float* c) {
+    return linearf(v, 1, c, c);
+}
+
+Animation* holdi(int* v, int n, int* c) {
+    return lineari(v, 1, c, c);
+}
+
+Animation* holdf1(float* v, float c) {
+    return linearf1(v, c, c);
+}
+
+Animation* holdi1(int* v, int c) {
+    return lineari1(v, c, c);
+}
+
+/* linear kernels
+ *
+ * v[i] = start[i] + (end[i] - start[i]) * f, for floats and for ints converted through float.  The vector kernels perform
+ * exactly the operations of the scalar ones, so all produce identical results.  The aligned kernels require v, start
+ * and end to be 32-byte aligned.
+ */
+
+typedef void (*LinearKernelF)(float* v, float* start, float* end, int n, float f);
+typedef void (*LinearKernelI)(int* v, int* start, int* end, int n, float f);
+
+typedef struct LinearKernelsStruct {
+    LinearKernelF f, f_aligned;
+    LinearKernelI i, i_aligned;
+} LinearKernels;
+
+void linear_kernelf_scalar(float* v, float* start, float* end, int n, float f) {
+    int i;
+    for (i=0; i<n; i++)
+        v[i] = start[i] + (end[i] - start[i]) * f;
+}
+
+void linear_kerneli_scalar(int* v, int* start, int* end, int n, float f) {
+    int i;
+    for (i=0; i<n; i++)
+        v[i] = start[i] + (end[i] - start[i]) * f;
+}
+
+#ifdef ANIM_X86_SIMD
+
+__attribute__((target("sse2")))
+void linear_kernelf_sse2(float* v, float* start, float* end, int n, float f) {
+    int i;
+    __m128 ff = _mm_set1_ps(f);
+    for (i=0; i+4<=n; i+=4) {
+        __m128 s = _mm_loadu_ps(start+i), e = _mm_loadu_ps(end+i);
+        _mm_storeu_ps(v+i, _mm_add_ps(s, _mm_mul_ps(_mm_sub_ps(e, s), ff)));
+    }
+    linear_kernelf_scalar(v+i, start+i, end+i, n-i, f);
+}
+
+__attribute__((target("sse2")))
+void linear_kernelf_sse2_aligned(float* v, float* start, float* end, int n, float f) {
+    int i;
+    __m128 ff = _mm_set1_ps(f);
+    for (i=0; i+4<=n; i+=4) {
+        __m128 s = _mm_load_ps(start+i), e = _mm_load_ps(end+i);
+        _mm_store_ps(v+i, _mm_add_ps(s, _mm_mul_ps(_mm_sub_ps(e, s), ff)));
+    }
+    linear_kernelf_scalar(v+i, start+i, end+i, n-i, f);
+}
+
+__attribute__((target("sse2")))
+void linear_kerneli_sse2(int* v, int* start, int* end, int n, float f) {
+    int i;
+    __m128 ff = _mm_set1_ps(f);
+    for (i=0; i+4<=n; i+=4) {
+        __m128i s = _mm_loadu_si128((__m128i*)(start+i)), e = _mm_loadu_si128((__m128i*)(end+i));
+        __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(e, s)), ff);
+        _mm_storeu_si128((__m128i*)(v+i), _mm_cvttps_epi32(_mm_add_ps(_mm_cvtepi32_ps(s), d)));
+    }
+    linear_kerneli_scalar(v+i, start+i, end+i, n-i, f);
+}
+
+__attribute__((target("sse2")))
+void linear_kerneli_sse2_aligned(int* v, int* start, int* end, int n, float f) {
+    int i;
+    __m128 ff = _mm_set1_ps(f);
+    for (i=0; i+4<=n; i+=4) {
+        __m128i s = _mm_load_si128((__m128i*)(start+i)), e = _mm_load_si128((__m128i*)(end+i));
+        __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(e, s)), ff);
+        _mm_store_si128((__m128i*)(v+i), _mm_cvttps_epi32(_mm_add_ps(_mm_cvtepi32_ps(s), d)));
+    }
+    linear_kerneli_scalar(v+i, start+i, end+i, n-i, f);
+}
+
+__attribute__((target("avx2")))
+void linear_kernelf_avx2(float* v, float* start, float* end, int n, float f) {
+    int i;
+    __m256 ff = _mm256_set1_ps(f);
+    for (i=0; i+8<=n; i+=8) {
+        __m256 s = _mm256_loadu_ps(start+i), e = _mm256_loadu_ps(end+i);
+        _mm256_storeu_ps(v+i, _mm256_add_ps(s, _mm256_mul_ps(_mm256_sub_ps(e, s), ff)));
+    }
+    linear_kernelf_scalar(v+i, start+i, end+i, n-i, f);
+}
+
+__attribute__((target("avx2")))
+void linear_kernelf_avx2_aligned(float* v, float* start, float* end, int n, float f) {
+    int i;
+    __m256 ff = _mm256_set1_ps(f);
+    for (i=0; i+8<=n; i+=8) {
+        __m256 s = _mm256_load_ps(start+i), e = _mm256_load_ps(end+i);
+        _mm256_store_ps(v+i, _mm256_add_ps(s, _mm256_mul_ps(_mm256_sub_ps(e, s), ff)));
+    }
+    linear_kernelf_scalar(v+i, start+i, end+i, n-i, f);
+}
+
+__attribute__((target("avx2")))
+void linear_kerneli_avx2(int* v, int* start, int* end, int n, float f) {
+    int i;
+    __m256 ff = _mm256_set1_ps(f);
+    for (i=0; i+8<=n; i+=8) {
+        __m256i s = _mm256_loadu_si256((__m256i*)(start+i)), e = _mm256_loadu_si256((__m256i*)(end+i));
+        __m256 d = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(e, s)), ff);
+        _mm256_storeu_si256((__m256i*)(v+i), _mm256_cvttps_epi32(_mm256_add_ps(_mm256_cvtepi32_ps(s), d)));
+    }
+    linear_kerneli_scalar(v+i, start+i, end+i, n-i, f);
+}
+
+__attribute__((target("avx2")))
+void linear_kerneli_avx2_aligned(int* v, int* start, int* end, int n, float f) {
+    int i;
+    __m256 ff = _mm256_set1_ps(f);
+    for (i=0; i+8<=n; i+=8) {
+        __m256i s = _mm256_load_si256((__m256i*)(start+i)), e = _mm256_load_si256((__m256i*)(end+i));
+        __m256 d = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(e, s)), ff);
+        _mm256_store_si256((__m256i*)(v+i), _mm256_cvttps_epi32(_mm256_add_ps(_mm256_cvtepi32_ps(s), d)));
+    }
+    linear_kerneli_scalar(v+i, start+i, end+i, n-i, f);
+}
+
+#endif
+
+/* the best kernels this cpu supports */
+const LinearKernels* linear_kernels() {
+    static const LinearKernels k[CPU_LEVELS] = {
+        { linear_kernelf_scalar, linear_kernelf_scalar, linear_kerneli_scalar, linear_kerneli_scalar },
+#ifdef ANIM_X86_SIMD
+        { linear_kernelf_sse2, linear_kernelf_sse2_aligned, linear_kerneli_sse2, linear_kerneli_sse2_aligned },
+        { linear_kernelf_avx2, linear_kernelf_avx2_aligned, linear_kerneli_avx2, linear_kerneli_avx2_aligned }
+#endif
+    };
+
+    return &k[cpu_level()];
+}
+
+gboolean is_aligned(void* p) {
+    return ((size_t)p) % 32 == 0;
+}
+
+/* linear animation (float) */
+
+typedef struct LinearAnimationFStruct {
+    Animation a;
+    float* v;
+    int n;
+    float* start;
+    float* end;
+    LinearKernelF kernel;
+    float storage[2]; /* start and end of a linearf1 */
+} LinearAnimationF;
+
+void linear_animationf_update(Animation* a, float f) {
+    LinearAnimationF* la = (LinearAnimationF*)a;
+    la->kernel(la->v, la->start, la->end, la->n, f);
+}
+
+void linear_animationf_free(Animation* a) {
+    LinearAnimationF* la = (LinearAnimationF*)a;
+    if (la->start != la->storage) {
+        free(la->start);
+        if (la->end != la->start)
+            free(la->end);
+    }
+    default_animation_free(a);
+}
+
+LinearAnimationF* mk_linearf(float* v, int n, float* start, float* end) {
+    g_assert(v != NULL);
+    g_assert(start != NULL);
+    g_assert(end != NULL);
+    g_assert_cmpint(n, >, 0);
+
+    LinearAnimationF* a = animation_alloc(sizeof(LinearAnimationF));
+    a->v      = v;
+    a->n      = n;
+    a->start  = start;
+    a->end    = end;
+    a->kernel = linear_kernels()->f;
+    animation_init(&a->a, ANIMATION_LINEARF, linear_animationf_update, default_animation_duration, linear_animationf_free, default_animation_visit);
+    if (memcmp(start, end, sizeof(float) * n) == 0)
+        animation_set_static(&a->a);
+    return a;
+}
+
+Animation* linearf(float* v, int n, float* start, float* end) {
+    /* a hold passes one array as both */
+    animation_adopt(start, free);
+    if (end != start)
+        animation_adopt(end, free);
+    return (Animation*)mk_linearf(v, n, start, end);
+}
+
+Animation* linearf1(float* v, float start, float end) {
+    float storage[2];
+    storage[0] = start;
+    storage[1] = end;
+
+    /* keep start and end in the node itself */
+    LinearAnimationF* a = mk_linearf(v, 1, storage, storage + 1);
+    a->storage[0] = start;
+    a->storage[1] = end;
+    a->start      = a->storage;
+    a->end        = a->storage + 1;
+    return (Animation*)a;
+}
+
+Animation* linearfa(float* v, int n, float* start, float* end) {
+    g_assert(is_aligned(v));
+    g_assert(is_aligned(start));
+    g_assert(is_aligned(end));
+
+    LinearAnimationF* a = (LinearAnimationF*)linearf(v, n, start, end);
+    a->kernel = linear_kernels()->f_aligned;
+    return (Animation*)a;
+}
+
+/* linear animation (int) */
+
+typedef struct LinearAnimationIStruct {
+    Animation a;
+    int* v;
+    int n;
+    int* start;
+    int* end;
+    LinearKernelI kernel;
+    int storage[2]; /* start and end of a lineari1 */
+} LinearAnimationI;
+
+void linear_animationi_update(Animation* a, float f) {
+    LinearAnimationI* la = (LinearAnimationI*)a;
+    la->kernel(la->v, la->start, la->end, la->n, f);
+}
+
+void linear_animationi_free(Animation* a) {
+    LinearAnimationI* la = (LinearAnimationI*)a;
+    if (la->start != la->storage) {
+        free(la->start);
+        if (la->end != la->start)
+            free(la->end);
+    }
+    default_animation_free(a);
+}
+
+LinearAnimationI* mk_lineari(int* v, int n, int* start, int* end) {
+    g_assert(v != NULL);
+    g_assert(start != NULL);
+    g_assert(end != NULL);
+    g_assert_cmpint(n, >, 0);
+
+    LinearAnimationI* a = animation_alloc(sizeof(LinearAnimationI));
+    a->v      = v;
+    a->n      = n;
+    a->start  = start;
+    a->end    = end;
+    a->kernel = linear_kernels()->i;
+    animation_init(&a->a, ANIMATION_LINEARI, linear_animationi_update, default_animation_duration, linear_animationi_free, default_animation_visit);
+    if (memcmp(start, end, sizeof(int) * n) == 0)
+        animation_set_static(&a->a);
+    return a;
+}
+
+Animation* lineari(int* v, int n, int* start, int* end) {
+    animation_adopt(start, free);
+    if (end != start)
+        animation_adopt(end, free);
+    return (Animation*)mk_lineari(v, n, start, end);
+}
+
+Animation* lineari1(int* v, int start, int end) {
+    int storage[2];
+    storage[0] = start;
+    storage[1] = end;
+
+    /* keep start and end in the node itself */
+    LinearAnimationI* a = mk_lineari(v, 1, storage, storage + 1);
+    a->storage[0] = start;
+    a->storage[1] = end;
+    a->start      = a->storage;
+    a->end        = a->storage + 1;
+    return (Animation*)a;
+}
+
+Animation* linearia(int* v, int n, int* start, int* end) {
+    g_assert(is_aligned(v));
+    g_assert(is_aligned(start));
+    g_assert(is_aligned(end));
+
+    LinearAnimationI* a = (LinearAnimationI*)lineari(v, n, start, end);
+    a->kernel = linear_kernels()->i_aligned;
+    return (Animation*)a;
+}
+
+/* bezier animation (float)
+ *
+ * The curve is evaluated in the Bernstein basis with Horner's scheme.  For f <= 1/2,
+ *   B(f) = (1-f)^d * sum_i binomial(d,i) P_i x^i, with x = f/(1-f) <= 1,
+ * and for f > 1/2 the same with the roles of f and 1-f (and the order of the points) swapped.  Keeping x <= 1 keeps the
+ * evaluation well conditioned, and the sums are taken in double precision so that binomial(d,i) does not overflow.
+ */
+
+typedef struct BezierAnimationFStruct {
+    Animation a;
+    float* v;
+    int n;
+    int m;
+    double* coefficients;    /* m rows of n: binomial(m-1, i) * control_points[i].  32-byte aligned */
+    double* working_storage; /* n, following the coefficients */
+} BezierAnimationF;
+
+void bezier_animationf_update(Animation* a, float f) {
+    BezierAnimationF* s = (BezierAnimationF*)a;
+
+    int i, k, n = s->n, d = s->m - 1;
+    double *b = s->coefficients, *acc = s->working_storage;
+    double w = 1.0, x;
+
+    if (f <= 0.5) {
+        x = f / (1.0 - f);
+        memcpy(acc, b + d*n, sizeof(double) * n);
+        for (i=d-1; i>=0; i--)
+            for (k=0; k<n; k++)
+                acc[k] = acc[k] * x + b[i*n + k];
+        for (i=0; i<d; i++)
+            w *= 1.0 - f;
+    } else {
+        x = (1.0 - f) / f;
+        memcpy(acc, b, sizeof(double) * n);
+        for (i=1; i<=d; i++)
+            for (k=0; k<n; k++)
+                acc[k] = acc[k] * x + b[i*n + k];
+        for (i=0; i<d; i++)
+            w *= f;
+    }
+
+    for (k=0; k<n; k++)
+        s->v[k] = acc[k] * w;
+}
+
+void bezier_animationf_free(Animation* a) {
+    BezierAnimationF* s = (BezierAnimationF*)a;
+    animation_aligned_free(s->coefficients);
+    default_animation_free(a);
+}
+
+Animation* bezierf(float* v, int n, int m, float** control_points) {
+    g_assert(v != NULL);
+    g_assert(control_points != NULL);
+    g_assert_cmpint(n, >, 0);
+    g_assert_cmpint(m, >, 0);
+
+    int i, k;
+    double binomial = 1.0;
+
+    BezierAnimationF* a = animation_alloc(sizeof(BezierAnimationF));
+    a->v               = v;
+    a->n               = n;
+    a->m               = m;
+    a->coefficients    = animation_alloc_aligned(sizeof(double) * (m+1) * n);
+    a->working_storage = a->coefficients + m*n;
+
+    for (i=0; i<m; i++) {
+        for (k=0; k<n; k++)
+            a->coefficients[i*n + k] = binomial * control_points[i][k];
+        binomial = binomial * (m-1-i) / (i+1);
+        free(control_points[i]);
+    }
+    free(control_points);
+
+    animation_init(&a->a, ANIMATION_BEZIERF, bezier_animationf_update, default_animation_duration, bezier_animationf_free, default_animation_visit);
+    return (Animation*)a;
+}
+
+/* cubic spline animation (float)
+ *
+ * A curve through k points is k-1 cubic segments of equal duration, each stored as the coefficients of c0 + c1 u + c2 u^2 + c3 u^3
+ * and evaluated with Horner's scheme, so finding and evaluating a segment costs the same however many points there are.
+ * Catmull-Rom and B-splines are given phantom end points P[-1] = 2P[0] - P[1] and P[k] = 2P[k-1] - P[k-2], so that they start and end on
+ * the first and last points.
+ */
+
+typedef struct SplineAnimationFStruct {
+    Animation a;
+    float* v;
+    int n;
+    int segments;
+    float* coefficients; /* for each segment, 4 rows of n.  32-byte aligned */
+} SplineAnimationF;
+
+void spline_animationf_update(Animation* a, float f) {
+    SplineAnimationF* s = (SplineAnimationF*)a;
+
+    int k, n = s->n;
+    float x = f * s->segments;
+    int i = (int)x;
+    if (i > s->segments - 1)
+        i = s->segments - 1;
+
+    float u = x - i, *c = s->coefficients + i*4*n, *v = s->v;
+    for (k=0; k<n; k++)
+        v[k] = ((c[3*n + k] * u + c[2*n + k]) * u + c[n + k]) * u + c[k];
+}
+
+void spline_animationf_free(Animation* a) {
+    SplineAnimationF* s = (SplineAnimationF*)a;
+    animation_aligned_free(s->coefficients);
+    default_animation_free(a);
+}
+
+SplineAnimationF* mk_spline(float* v, int n, int k, float** points) {
+    g_assert(v != NULL);
+    g_assert(points != NULL);
+    g_assert_cmpint(n, >, 0);
+    g_assert_cmpint(k, >, 1);
+
+    SplineAnimationF* a = animation_alloc(sizeof(SplineAnimationF));
+    a->v            = v;
+    a->n            = n;
+    a->segments     = k - 1;
+    a->coefficients = animation_alloc_aligned(sizeof(float) * 4 * n * (k-1));
+    return a;
+}
+
+Animation* finish_spline(SplineAnimationF* a, int k, float** points) {
+    int i;
+    for (i=0; i<k; i++)
+        free(points[i]);
+    free(points);
+
+    animation_init(&a->a, ANIMATION_SPLINEF, spline_animationf_update, default_animation_duration, spline_animationf_free, default_animation_visit);
+    return (Animation*)a;
+}
+
+/* point i of dimension j, with the phantom end points */
+double spline_point(float** points, int k, int i, int j) {
+    if (i < 0)
+        return 2.0 * points[0][j] - points[1][j];
+    if (i >= k)
+        return 2.0 * points[k-1][j] - points[k-2][j];
+    return points[i][j];
+}
+
+Animation* catmullromf(float* v, int n, int k, float** points) {
+    SplineAnimationF* a = mk_spline(v, n, k, points);
+
+    int i, j;
+    for (i=0; i<k-1; i++)
+        for (j=0; j<n; j++) {
+            double p0 = spline_point(points, k, i-1, j), p1 = points[i][j], p2 = points[i+1][j], p3 = spline_point(points, k, i+2, j);
+            float* c = a->coefficients + i*4*n + j;
+            c[0]   = p1;
+            c[n]   = 0.5 * (p2 - p0);
+            c[2*n] = 0.5 * (2.0*p0 - 5.0*p1 + 4.0*p2 - p3);
+            c[3*n] = 0.5 * (3.0*p1 - p0 - 3.0*p2 + p3);
+        }
+
+    return finish_spline(a, k, points);
+}
+
+Animation* bsplinef(float* v, int n, int k, float** points) {
+    SplineAnimationF* a = mk_spline(v, n, k, points);
+
+    int i, j;
+    for (i=0; i<k-1; i++)
+        for (j=0; j<n; j++) {
+            double p0 = spline_point(points, k, i-1, j), p1 = points[i][j], p2 = points[i+1][j], p3 = spline_point(points, k, i+2, j);
+            float* c = a->coefficients + i*4*n + j;
+            c[0]   = (p0 + 4.0*p1 + p2) / 6.0;
+            c[n]   = (p2 - p0) / 2.0;
+            c[2*n] = (p0 - 2.0*p1 + p2) / 2.0;
+            c[3*n] = (3.0*p1 - p0 - 3.0*p2 + p3) / 6.0;
+        }
+
+    return finish_spline(a, k, points);
+}
+
+Animation* naturalsplinef(float* v, int n, int k, float** points) {
+    SplineAnimationF* a = mk_spline(v, n, k, points);
+
+    /* second derivatives m, with m[0] = m[k-1] = 0 and m[i-1] + 4m[i] + m[i+1] = 6(p[i+1] - 2p[i] + p[i-1]), by the Thomas algorithm */
+    double* m = malloc(sizeof(double) * k);
+    double* scratch = malloc(sizeof(double) * k);
+
+    int i, j;
+    for (j=0; j<n; j++) {
+        m[0] = m[k-1] = 0.0;
+        scratch[0] = 0.0;
+
+        for (i=1; i<k-1; i++) {
+            double w = 4.0 - scratch[i-1];
+            scratch[i] = 1.0 / w;
+            m[i] = (6.0 * (points[i+1][j] - 2.0*points[i][j] + points[i-1][j]) - m[i-1]) / w;
+        }
+        for (i=k-3; i>=1; i--)
+            m[i] -= scratch[i] * m[i+1];
+
+        for (i=0; i<k-1; i++) {
+            float* c = a->coefficients + i*4*n + j;
+            c[0]   = points[i][j];
+            c[n]   = (points[i+1][j] - points[i][j]) - (2.0*m[i] + m[i+1]) / 6.0;
+            c[2*n] = m[i] / 2.0;
+            c[3*n] = (m[i+1] - m[i]) / 6.0;
+        }
+    }
+
+    free(m);
+    free(scratch);
+    return finish_spline(a, k, points);
+}
+
+/* keyframe animation (float)
+ *
+ * A track of keys at increasing times, held as parallel arrays in one block.  The key in effect is found by resuming from the
+ * one used last time, or by binary search after a jump.  Cubic keys are cubic Hermite segments with Catmull-Rom tangents.
+ */
+
+typedef struct KeyframeAnimationFStruct {
+    Animation a;
+    float* v;
+    int n;
+    int count;
+    float* times;          /* count */
+    float* values;         /* count rows of n */
+    float* tangents;       /* count rows of n, in value per unit of time */
+    unsigned char* modes;  /* count */
+    int cursor;            /* the key in effect at the last update */
+} KeyframeAnimationF;
+
+/* the last key at or before t, given times[0] <= t < times[count-1] */
+int keyframe_animationf_find(KeyframeAnimationF* ka, float t) {
+    int c = ka->cursor, lo = 0, hi = ka->count - 2;
+
+    if (ka->times[c] <= t && t < ka->times[c+1])
+        return c;
+    if (c+2 < ka->count && ka->times[c+1] <= t && t < ka->times[c+2])
+        return c+1;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (ka->times[mid] <= t)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
+void keyframe_animationf_update(Animation* a, float f) {
+    KeyframeAnimationF* ka = (KeyframeAnimationF*)a;
+
+    int j, n = ka->n;
+    float t = ka->times[0] + f;
+
+    if (t >= ka->times[ka->count-1]) {
+        memcpy(ka->v, ka->values + (ka->count-1)*n, sizeof(float) * n);
+        return;
+    }
+
+    int i = ka->cursor = keyframe_animationf_find(ka, t);
+    float *p0 = ka->values + i*n, *p1 = p0 + n;
+    float h = ka->times[i+1] - ka->times[i], u = (t - ka->times[i]) / h;
+
+    switch (ka->modes[i]) {
+    case KEYFRAME_STEP:
+        memcpy(ka->v, p0, sizeof(float) * n);
+        break;
+
+    case KEYFRAME_LINEAR:
+        for (j=0; j<n; j++)
+            ka->v[j] = p0[j] + (p1[j] - p0[j]) * u;
+        break;
+
+    case KEYFRAME_CUBIC: {
+        float *m0 = ka->tangents + i*n, *m1 = m0 + n;
+        float u2 = u*u, u3 = u2*u;
+        float h00 = 2*u3 - 3*u2 + 1, h10 = (u3 - 2*u2 + u) * h, h01 = 3*u2 - 2*u3, h11 = (u3 - u2) * h;
+        for (j=0; j<n; j++)
+            ka->v[j] = h00*p0[j] + h10*m0[j] + h01*p1[j] + h11*m1[j];
+        break;
+    }
+    }
+}
+
+float keyframe_animationf_duration(Animation* a) {
+    KeyframeAnimationF* ka = (KeyframeAnimationF*)a;
+    return ka->times[ka->count-1] - ka->times[0];
+}
+
+void keyframe_animationf_free(Animation* a) {
+    KeyframeAnimationF* ka = (KeyframeAnimationF*)a;
+    animation_aligned_free(ka->times);
+    default_animation_free(a);
+}
+
+Animation* keyframesf(float* v, int n, int count, float* times, float* values, KeyframeMode* modes) {
+    g_assert(v != NULL);
+    g_assert(times != NULL);
+    g_assert(values != NULL);
+    g_assert_cmpint(n, >, 0);
+    g_assert_cmpint(count, >, 0);
+
+    int i, j;
+    for (i=1; i<count; i++)
+        g_assert_cmpfloat(times[i], >, times[i-1]);
+
+    KeyframeAnimationF* a = animation_alloc(sizeof(KeyframeAnimationF));
+    a->v        = v;
+    a->n        = n;
+    a->count    = count;
+    a->cursor   = 0;
+    a->times    = animation_alloc_aligned(sizeof(float) * count * (1 + 2*n) + count);
+    a->values   = a->times + count;
+    a->tangents = a->values + count*n;
+    a->modes    = (unsigned char*)(a->tangents + count*n);
+
+    memcpy(a->times, times, sizeof(float) * count);
+    memcpy(a->values, values, sizeof(float) * count * n);
+    for (i=0; i<count; i++)
+        a->modes[i] = (modes == NULL) ? KEYFRAME_LINEAR : modes[i];
+
+    /* finite-difference tangents, one-sided at the ends */
+    for (i=0; i<count; i++) {
+        int i0 = (i > 0) ? i-1 : i, i1 = (i < count-1) ? i+1 : i;
+        for (j=0; j<n; j++)
+            a->tangents[i*n + j] = (i0 == i1) ? 0.0 : (values[i1*n + j] - values[i0*n + j]) / (times[i1] - times[i0]);
+    }
+
+    animation_init(&a->a, ANIMATION_KEYFRAMESF, keyframe_animationf_update, keyframe_animationf_duration, keyframe_animationf_free, default_animation_visit);
+    return (Animation*)a;
+}
+
+/* scaled animation */
+
+typedef struct ScaledAnimationStruct {
+    Animation a;
+    Animation* child;
+    float scale_factor;
+} ScaledAnimation;
+
+void scaled_animation_update(Animation* a, float f) {
+    ScaledAnimation* sa = (ScaledAnimation*)a;
+    animation_update_child(a, sa->child, f / sa->scale_factor);
+}
+
+void scaled_animation_free(Animation* a) {
+    ScaledAnimation* sa = (ScaledAnimation*)a;
+    animation_free(sa->child);
+    default_animation_free(a);
+}
+
+float scaled_animation_duration(Animation* a) {
+    ScaledAnimation* sa = (ScaledAnimation*)a;
+    return animation_duration(sa->child) * sa->scale_factor;
+}
+
+void scaled_animation_visit(Animation* a, AnimationVisitor visitor, void* data) {
+    ScaledAnimation* sa = (ScaledAnimation*)a;
+    visitor(sa->child, data);
+}
+
+Animation* scale(Animation* a, float scale_factor) {
+    g_assert(a != NULL);
+    g_assert_cmpfloat(scale_factor, !=, 0);
+
+    animation_adopt_child(a);
+
+    ScaledAnimation* s = animation_alloc(sizeof(ScaledAnimation));
+    s->child        = a;
+    s->scale_factor = scale_factor;
+    animation_init(&s->a, ANIMATION_SCALED, scaled_animation_update, scaled_animation_duration, scaled_animation_free, scaled_animation_visit);
+    return (Animation*)s;
+}
+
+/* transformed animation */
+
+typedef struct TransformedAnimationStruct {
+    Animation a;
+    Animation* child;
+    TimeTransform* t;
+} TransformedAnimation;
+
+void transformed_animation_update(Animation* a, float f) {
+    TransformedAnimation* ta = (TransformedAnimation*)a;
+
+    float d = ta->child->cached_duration;
+    float t = a->sealed ? ta->t->f(ta->t, f / d) : apply_transform(ta->t, f / d);
+    animation_update_child(a, ta->child, t * d);
+}
+
+void transformed_animation_free(Animation* a) {
+    TransformedAnimation* ta = (TransformedAnimation*)a;
+    animation_free(ta->child);
+    time_transform_free(ta->t);
+    default_animation_free(a);
+}
+
+float transformed_animation_duration(Animation* a) {
+    TransformedAnimation* ta = (TransformedAnimation*)a;
+    return animation_duration(ta->child);
+}
+
+void transformed_animation_visit(Animation* a, AnimationVisitor visitor, void* data) {
+    TransformedAnimation* ta = (TransformedAnimation*)a;
+    visitor(ta->child, data);
+}
+
+Animation* transform(Animation* a, TimeTransform* t) {
+    g_assert(a != NULL);
+    g_assert(t != NULL);
+
+    animation_adopt_child(a);
+    if (t->arena == NULL)
+        animation_adopt(t, time_transform_free);
+
+    TransformedAnimation* ta = animation_alloc(sizeof(TransformedAnimation));
+    ta->child = a;
+    ta->t     = t;
+    animation_init(&ta->a, ANIMATION_TRANSFORMED, transformed_animation_update, transformed_animation_duration, transformed_animation_free, transformed_animation_visit);
+    return (Animation*)ta;
+}
+
+/* sequence animation */
+
+typedef struct SequenceAnimationStruct {
+    Animation a;
+    Animation* a1;
+    Animation* a2;
+    int active;    /* the child updated last, or -1 */
+} SequenceAnimation;
+
+void sequence_animation_update(Animation* a, float f) {
+    SequenceAnimation* as = (SequenceAnimation*)a;
+
+    float d = as->a1->cached_duration;
+
+    int i = (f <= d) ? 0 : 1;
+    Animation* child = i ? as->a2 : as->a1;
+
+    /* the other child may have overwritten what this one wrote */
+    if (i != as->active) {
+        animation_mark_stale(child);
+        as->active = i;
+    }
+
+    animation_update_child(a, child, i ? f-d : f);
+}
+
+void sequence_animation_free(Animation* a) {
+    SequenceAnimation* as = (SequenceAnimation*)a;
+    animation_free(as->a1);
+    animation_free(as->a2);
+    default_animation_free(a);
+}
+
+float sequence_animation_duration(Animation* a) {
+    SequenceAnimation* as = (SequenceAnimation*)a;
+    return animation_duration(as->a1) + animation_duration(as->a2);
+}
+
+void sequence_animation_visit(Animation* a, AnimationVisitor visitor, void* data) {
+    SequenceAnimation* as = (SequenceAnimation*)a;
+    visitor(as->a1, data);
+    visitor(as->a2, data);
+}
+
+Animation* sequence(Animation* a1, Animation* a2) {
+    g_assert(a1 != NULL);
+    g_assert(a2 != NULL);
+
+    animation_adopt_child(a1);
+    animation_adopt_child(a2);
+
+    SequenceAnimation* a = animation_alloc(sizeof(SequenceAnimation));
+    a->a1     = a1;
+    a->a2     = a2;
+    a->active = -1;
+    animation_init(&a->a, ANIMATION_SEQUENCE, sequence_animation_update, sequence_animation_duration, sequence_animation_free, sequence_animation_visit);
+    return (Animation*)a;
+}
+
+Animation* sequencen(Animation *a1, ...) {
+    g_assert(a1 != NULL);
+
+    GPtrArray* as = g_ptr_array_new();
+    g_ptr_array_add(as, a1);
+
+    va_list args;
+    va_start(args, a1);
+    while (TRUE) {
+        Animation* a = va_arg(args, Animation*);
+        if (a == NULL)
+            break;
+        g_ptr_array_add(as, a);
+    }
+    va_end(args);
+
+    Animation* result = (as->len == 1) ? a1 : sequencev((Animation**)as->pdata, as->len);
+    g_ptr_array_free(as, TRUE);
+    return result;
+}
+
+/* flat sequence animation - n children, with the active child found by binary search over their start times */
+
+typedef struct FlatSequenceAnimationStruct {
+    Animation a;
+    int n;
+    Animation** children;
+    float* starts; /* n+1 prefix sums of the children's durations.  child i is active over (starts[i], starts[i+1]] */
+    int cursor;    /* the child that was active at the last update */
+    int active;    /* the child updated last, or -1.  unlike the cursor, batch sampling leaves this alone */
+} FlatSequenceAnimation;
+
+/* how many children a lookup will step over from the cursor before falling back to binary search */
+#define SEQUENCE_CURSOR_SCAN 4
+
+gboolean sequence_active(const float* starts, int i, float f) {
+    return f <= starts[i+1] && (i == 0 || f > starts[i]);
+}
+
+/* the child of n with the given start times that is active at f, starting from the one at cursor */
+int sequence_find(const float* starts, int n, int cursor, float f) {
+    int lo = 0, hi = n - 1;
+
+    /* playback is mostly monotonic, so try the children around the last active one first */
+    int i, c = cursor;
+    for (i=0; i<=SEQUENCE_CURSOR_SCAN; i++) {
+        if (c+i < n && sequence_active(starts, c+i, f))
+            return c+i;
+        if (i > 0 && c-i >= 0 && sequence_active(starts, c-i, f))
+            return c-i;
+    }
+
+    /* the first child whose end is at or after f */
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (f <= starts[mid+1])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return lo;
+}
+
+gboolean flat_sequence_animation_active(FlatSequenceAnimation* as, int i, float f) {
+    return sequence_active(as->starts, i, f);
+}
+
+int flat_sequence_animation_find(FlatSequenceAnimation* as, float f) {
+    return sequence_find(as->starts, as->n, as->cursor, f);
+}
+
+void flat_sequence_animation_update(Animation* a, float f) {
+    FlatSequenceAnimation* as = (FlatSequenceAnimation*)a;
+
+    int i = as->cursor = flat_sequence_animation_find(as, f);
+    float t = f - as->starts[i], d = as->children[i]->cached_duration;
+
+    if (i != as->active) {
+        animation_mark_stale(as->children[i]);
+        as->active = i;
+    }
+
+    animation_update_child(a, as->children[i], t < d ? t : d);
+}
+
+void flat_sequence_animation_free(Animation* a) {
+    FlatSequenceAnimation* as = (FlatSequenceAnimation*)a;
+
+    int i;
+    for (i=0; i<as->n; i++)
+        animation_free(as->children[i]);
+
+    free(as->children);
+    free(as->starts);
+    default_animation_free(a);
+}
+
+float flat_sequence_animation_duration(Animation* a) {
+    FlatSequenceAnimation* as = (FlatSequenceAnimation*)a;
+
+    int i;
+    as->starts[0] = 0.0;
+    for (i=0; i<as->n; i++)
+        as->starts[i+1] = as->starts[i] + animation_duration(as->children[i]);
+
+    return as->starts[as->n];
+}
+
+void flat_sequence_animation_visit(Animation* a, AnimationVisitor visitor, void* data) {
+    FlatSequenceAnimation* as = (FlatSequenceAnimation*)a;
+
+    int i;
+    for (i=0; i<as->n; i++)
+        visitor(as->children[i], data);
+}
+
+Animation* sequencev(Animation** as, int n) {
+    g_assert(as != NULL);
+    g_assert_cmpint(n, >, 0);
+
+    int i;
+    for (i=0; i<n; i++) {
+        g_assert(as[i] != NULL);
+        animation_adopt_child(as[i]);
+    }
+
+    FlatSequenceAnimation* a = animation_alloc(sizeof(FlatSequenceAnimation));
+    a->n        = n;
+    a->children = animation_alloc(sizeof(Animation*) * n);
+    a->starts   = animation_alloc(sizeof(float) * (n+1));
+    a->cursor   = 0;
+    a->active   = -1;
+    memcpy(a->children, as, sizeof(Animation*) * n);
+    animation_init(&a->a, ANIMATION_FLAT_SEQUENCE, flat_sequence_animation_update, flat_sequence_animation_duration, flat_sequence_animation_free, flat_sequence_animation_visit);
+    return (Animation*)a;
+}
+
+/* parallel animation */
+
+typedef struct ParallelAnimationStruct {
+    Animation a;
+    Animation* a1;
+    Animation* a2;
+} ParallelAnimation;
+
+void parallel_animation_update(Animation* a, float f) {
+    ParallelAnimation* as = (ParallelAnimation*)a;
+    if (a->shared) {
+        animation_mark_stale(as->a1);
+        animation_mark_stale(as->a2);
+    }
+    animation_update_child(a, as->a1, f);
+    animation_update_child(a, as->a2, f);
+}
+
+void parallel_animation_free(Animation* a) {
+    ParallelAnimation* as = (ParallelAnimation*)a;
+    animation_free(as->a1);
+    animation_free(as->a2);
+    default_animation_free(a);
+}
+
+float parallel_animation_duration(Animation* a) {
+    ParallelAnimation* as = (ParallelAnimation*)a;
+    return animation_duration(as->a1);
+}
+
+void parallel_animation_visit(Animation* a, AnimationVisitor visitor, void* data) {
+    ParallelAnimation* as = (ParallelAnimation*)a;
+    visitor(as->a1, data);
+    visitor(as->a2, data);
+}
+
+Animation* parallel(Animation* a1, Animation* a2) {
+    g_assert(a1 != NULL);
+    g_assert(a2 != NULL);
+    g_assert_cmpfloat(animation_duration(a1), ==, animation_duration(a2));
+
+    animation_adopt_child(a1);
+    animation_adopt_child(a2);
+
+    ParallelAnimation* a = animation_alloc(sizeof(ParallelAnimation));
+    a->a1 = a1;
+    a->a2 = a2;
+    animation_init(&a->a, ANIMATION_PARALLEL, parallel_animation_update, parallel_animation_duration, parallel_animation_free, parallel_animation_visit);
+    return (Animation*)a;
+}
+
+Animation* paralleln(Animation *a1, ...) {
+    Animation *result = a1;
+
+    va_list args;
+    va_start(args, a1);
+    while (TRUE) {
+        Animation* a = va_arg(args, Animation*);
+        if (a == NULL)
+            break;
+        result = parallel(result, a);
+    }
+
+    return result;
+}
+
+Animation* parallelp(Animation *a1, Animation* a2) {
+    float d1 = animation_duration(a1), d2 = animation_duration(a2);
+
+    if (d1 < d2)
+        return parallel(pad_to(a1, d2), a2);
+
+    if (d1 > d2)
+        return parallel(a1, pad_to(a2, d1));
+
+    return parallel(a1, a2);
+}
+
+Animation* parallelpn(Animation *a1, ...) {
+    Animation *result = a1;
+
+    va_list args;
+    va_start(args, a1);
+    while (TRUE) {
+        Animation* a = va_arg(args, Animation*);
+        if (a == NULL)
+            break;
+        result = parallelp(result, a);
+    }
+
+    return result;
+}
+
+/* higher-level operations */
+
+Animation* delay(Animation* a, float d) {
+    g_assert(a != NULL);
+    return sequence(scale(null_animation(), d), a);
+}
+
+Animation* pad_by(Animation* a, float d) {
+    return sequence(a, scale(null_animation(), d));
+}
+
+Animation* pad_to(Animation* a, float d) {
+    return pad_by(a, d - animation_duration(a));
+}
+
+Animation* identity(Animation* a) {
+    g_assert(a != NULL);
+    return transform(a, identity_transform());
+}
+
+Animation* sinusoid(Animation* a) {
+    g_assert(a != NULL);
+    return transform(a, sinusoid_transform());
+}
+
+Animation* reverse(Animation* a) {
+    g_assert(a != NULL);
+    return transform(a, reverse_transform());
+}
+
+Animation* exponent(Animation* a, float f) {
+    g_assert(a != NULL);
+    g_assert_cmpfloat(f, !=, 0.0);
+    return transform(a, exponent_transform(f));
+}
+
+/* derived values */
+
+typedef void (*UpdateDerivedValueFunction)(DerivedValue*);
+typedef void (*FreeDerivedValueFunction)(DerivedValue*);
+
+struct DerivedValueStruct {
+    UpdateDerivedValueFunction update;
+    FreeDerivedValueFunction free;
+    AnimationArena* arena;
+    const char* in;  /* the bytes the value is computed from, in_bytes of them.  0 if unknown */
+    char* out;       /* the bytes it writes, out_bytes of them */
+    int in_bytes, out_bytes;
+};
+
+void derived_value_update(DerivedValue* dv) {
+    dv->update(dv);
+}
+
+void derived_value_free(DerivedValue* dv) {
+    /* released with its arena */
+    if (dv->arena != NULL)
+        return;
+
+    dv->free(dv);
+}
+
+void derived_value_free_adopted(void* dv) {
+    derived_value_free(dv);
+}
+
+void default_derived_value_free(DerivedValue* dv) {
+    free(dv);
+}
+
+/* concrete derived values */
+
+typedef struct ConcreteDerivedValueStruct {
+    DerivedValue dv;
+    void* transform;
+    int n;
+    void* in;
+    void* out;
+    float a, b;   /* parameters of the built-in clamp and affine transforms */
+} ConcreteDerivedValue;
+
+void concrete_derived_value_update(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    ((TransformN)cdv->transform)(cdv->n, cdv->in, cdv->out);
+}
+
+void concrete_derived_value_update_ff(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    *((float*)cdv->out) = ((TransformFF)cdv->transform)(*((float*)cdv->in));
+}
+
+void concrete_derived_value_update_fi(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    *((int*)cdv->out) = ((TransformFI)cdv->transform)(*((float*)cdv->in));
+}
+
+void concrete_derived_value_update_if(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    *((float*)cdv->out) = ((TransformIF)cdv->transform)(*((int*)cdv->in));
+}
+
+void concrete_derived_value_update_ii(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    *((int*)cdv->out) = ((TransformII)cdv->transform)(*((int*)cdv->in));
+}
+
+void concrete_derived_value_update_ffn(DerivedValue* dv) {
+    int i;
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    for (i = 0; i < cdv->n; i++)
+        ((float*)cdv->out)[i] = ((TransformFF)cdv->transform)(((float*)cdv->in)[i]);
+}
+
+void concrete_derived_value_update_fin(DerivedValue* dv) {
+    int i;
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    for (i = 0; i < cdv->n; i++)
+        ((int*)cdv->out)[i] = ((TransformFI)cdv->transform)(((float*)cdv->in)[i]);
+}
+
+void concrete_derived_value_update_ifn(DerivedValue* dv) {
+    int i;
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    for (i = 0; i < cdv->n; i++)
+        ((float*)cdv->out)[i] = ((TransformIF)cdv->transform)(((int*)cdv->in)[i]);
+}
+
+void concrete_derived_value_update_iin(DerivedValue* dv) {
+    int i;
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    for (i = 0; i < cdv->n; i++)
+        ((int*)cdv->out)[i] = ((TransformII)cdv->transform)(((int*)cdv->in)[i]);
+}
+
+/* in_size and out_size are the sizes of the elements of in and out, or 0 if they are not known */
+DerivedValue* mk_cdv(UpdateDerivedValueFunction update, void* f, int n, void* in, void* out, int in_size, int out_size) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)animation_alloc(sizeof(ConcreteDerivedValue));
+    cdv->dv.update    = update;
+    cdv->dv.free      = default_derived_value_free;
+    cdv->dv.arena     = current_arena();
+    cdv->dv.in        = in;
+    cdv->dv.out       = out;
+    cdv->dv.in_bytes  = n * in_size;
+    cdv->dv.out_bytes = n * out_size;
+    cdv->transform = f;
+    cdv->n         = n;
+    cdv->in        = in;
+    cdv->out       = out;
+    return (DerivedValue*)cdv;
+}
+
+DerivedValue* derive(TransformN f, int n, void* in, void* out) {
+    return mk_cdv(concrete_derived_value_update, f, n, in, out, 0, 0);
+}
+
+DerivedValue* deriveff(TransformFF f, float* in, float* out) {
+    return mk_cdv(concrete_derived_value_update_ff, f, 1, in, out, sizeof(float), sizeof(float));
+}
+
+DerivedValue* derivefi(TransformFI f, float* in, int* out) {
+    return mk_cdv(concrete_derived_value_update_fi, f, 1, in, out, sizeof(float), sizeof(int));
+}
+
+DerivedValue* deriveif(TransformIF f, int* in, float* out) {
+    return mk_cdv(concrete_derived_value_update_if, f, 1, in, out, sizeof(int), sizeof(float));
+}
+
+DerivedValue* deriveii(TransformII f, int* in, int* out) {
+    return mk_cdv(concrete_derived_value_update_ii, f, 1, in, out, sizeof(int), sizeof(int));
+}
+
+DerivedValue* mapderiveff(TransformFF f, int n, float* in, float* out) {
+    return mk_cdv(concrete_derived_value_update_ffn, f, n, in, out, sizeof(float), sizeof(float));
+}
+
+DerivedValue* mapderivefi(TransformFI f, int n, float* in, int* out) {
+    return mk_cdv(concrete_derived_value_update_fin, f, n, in, out, sizeof(float), sizeof(int));
+}
+
+DerivedValue* mapderiveif(TransformIF f, int n, int* in, float* out) {
+    return mk_cdv(concrete_derived_value_update_ifn, f, n, in, out, sizeof(int), sizeof(float));
+}
+
+DerivedValue* mapderiveii(TransformII f, int n, int* in, int* out) {
+    return mk_cdv(concrete_derived_value_update_iin, f, n, in, out, sizeof(int), sizeof(int));
+}
+
+/* array transforms - transform n values with one call */
+
+void concrete_derived_value_update_ffv(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    ((TransformFFV)cdv->transform)(cdv->in, cdv->out, cdv->n);
+}
+
+void concrete_derived_value_update_fiv(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    ((TransformFIV)cdv->transform)(cdv->in, cdv->out, cdv->n);
+}
+
+void concrete_derived_value_update_ifv(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    ((TransformIFV)cdv->transform)(cdv->in, cdv->out, cdv->n);
+}
+
+void concrete_derived_value_update_iiv(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    ((TransformIIV)cdv->transform)(cdv->in, cdv->out, cdv->n);
+}
+
+DerivedValue* mapderiveffv(TransformFFV f, int n, float* in, float* out) {
+    return mk_cdv(concrete_derived_value_update_ffv, f, n, in, out, sizeof(float), sizeof(float));
+}
+
+DerivedValue* mapderivefiv(TransformFIV f, int n, float* in, int* out) {
+    return mk_cdv(concrete_derived_value_update_fiv, f, n, in, out, sizeof(float), sizeof(int));
+}
+
+DerivedValue* mapderiveifv(TransformIFV f, int n, int* in, float* out) {
+    return mk_cdv(concrete_derived_value_update_ifv, f, n, in, out, sizeof(int), sizeof(float));
+}
+
+DerivedValue* mapderiveiiv(TransformIIV f, int n, int* in, int* out) {
+    return mk_cdv(concrete_derived_value_update_iiv, f, n, in, out, sizeof(int), sizeof(int));
+}
+
+/* vector kernels for the built-in array transforms
+ *
+ * sin and cos reduce their argument to [-pi/4, pi/4] around the nearest multiple of pi/2 and evaluate a polynomial there.
+ * The reduction subtracts pi/2 in three parts, which stays within 1e-7 for |x| < 2^13; larger and non-finite arguments
+ * go to the C library instead.  round rounds halfway cases away from zero.  ftoi truncates as a cast does, saturates
+ * outside the range of int and takes NaN to 0.  As with the linear kernels, the vector kernels perform exactly the
+ * operations of the scalar ones, and hand any group holding an argument sin and cos cannot reduce to the scalar kernel,
+ * so all produce identical results for every input.
+ */
+
+typedef void (*TransformFFV2)(const float* in, float* out, int n, float a, float b);
+
+typedef struct TransformKernelsStruct {
+    void (*sincos)(const float* in, float* out, int n, int quadrant); /* quadrant 0 for sin, 1 for cos */
+    TransformFFV round;
+    TransformFIV ftoi;
+    TransformIFV itof;
+    TransformFFV2 clamp, affine;
+} TransformKernels;
+
+#define TWO_OVER_PI 0.636619772367581343f
+#define PIO2_1 1.5703125f                   /* pi/2 split in three, the first two exact in few bits */
+#define PIO2_2 4.837512969970703125e-4f
+#define PIO2_3 7.54978995489188216e-8f
+#define SIN_0 -1.6666654611e-1f
+#define SIN_1 8.3321608736e-3f
+#define SIN_2 -1.9515295891e-4f
+#define COS_0 4.166664568298827e-2f
+#define COS_1 -1.388731625493765e-3f
+#define COS_2 2.443315711809948e-5f
+#define ROUND_EXACT 8388608.0f              /* 2^23: floats at least this large are integers */
+#define SINCOS_REDUCIBLE 8192.0f            /* 2^13: the largest argument reduced in three parts */
+#define FTOI_LIMIT 2147483648.0f            /* 2^31: the smallest float above the range of int */
+
+void sincos_kernel_scalar(const float* in, float* out, int n, int quadrant) {
+    int i;
+    for (i=0; i<n; i++) {
+        float x = in[i];
+        if (!(fabs(x) <= SINCOS_REDUCIBLE)) {
+            out[i] = quadrant ? cos(x) : sin(x);
+            continue;
+        }
+
+        int q = (int)(x * TWO_OVER_PI + ((x < 0.0f) ? -0.5f : 0.5f));
+        float y = (float)q;
+        float r = ((x - y * PIO2_1) - y * PIO2_2) - y * PIO2_3;
+        float z = r * r;
+        float s = r + r * z * ((SIN_2 * z + SIN_1) * z + SIN_0);
+        float c = (1.0f - 0.5f * z) + z * z * ((COS_2 * z + COS_1) * z + COS_0);
+        int j = q + quadrant;
+        float v = (j & 1) ? c : s;
+        out[i] = (j & 2) ? -v : v;
+    }
+}
+
+void round_kernel_scalar(const float* in, float* out, int n) {
+    int i;
+    for (i=0; i<n; i++) {
+        float x = in[i];
+        if (!(fabs(x) < ROUND_EXACT)) {
+            out[i] = x;
+            continue;
+        }
+
+        float t = (float)(int)x, d = x - t;
+        out[i] = (t + ((d >= 0.5f) ? 1.0f : 0.0f)) - ((d <= -0.5f) ? 1.0f : 0.0f);
+    }
+}
+
+void ftoi_kernel_scalar(const float* in, int* out, int n) {
+    int i;
+    for (i=0; i<n; i++) {
+        float x = in[i];
+        out[i] = (x >= FTOI_LIMIT) ? G_MAXINT : (x < -FTOI_LIMIT) ? G_MININT : (x == x) ? (int)x : 0;
+    }
+}
+
+void itof_kernel_scalar(const int* in, float* out, int n) {
+    int i;
+    for (i=0; i<n; i++)
+        out[i] = (float)in[i];
+}
+
+void clamp_kernel_scalar(const float* in, float* out, int n, float lo, float hi) {
+    int i;
+    for (i=0; i<n; i++) {
+        float t = (in[i] > lo) ? in[i] : lo;
+        out[i] = (t < hi) ? t : hi;
+    }
+}
+
+void affine_kernel_scalar(const float* in, float* out, int n, float scale, float offset) {
+    int i;
+    for (i=0; i<n; i++)
+        out[i] = in[i] * scale + offset;
+}
+
+#ifdef ANIM_X86_SIMD
+
+__attribute__((target("sse2")))
+void sincos_kernel_sse2(const float* in, float* out, int n, int quadrant) {
+    int i;
+    __m128 sign = _mm_set1_ps(-0.0f);
+    for (i=0; i+4<=n; i+=4) {
+        __m128 x = _mm_loadu_ps(in+i);
+        if (_mm_movemask_ps(_mm_cmpnle_ps(_mm_andnot_ps(sign, x), _mm_set1_ps(SINCOS_REDUCIBLE))) != 0) {
+            sincos_kernel_scalar(in+i, out+i, 4, quadrant);
+            continue;
+        }
+
+        __m128 half = _mm_or_ps(_mm_and_ps(x, sign), _mm_set1_ps(0.5f));
+        __m128i q = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)), half));
+        __m128 y = _mm_cvtepi32_ps(q);
+        __m128 r = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PIO2_1))), _mm_mul_ps(y, _mm_set1_ps(PIO2_2))), _mm_mul_ps(y, _mm_set1_ps(PIO2_3)));
+        __m128 z = _mm_mul_ps(r, r);
+        __m128 ps = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_2), z), _mm_set1_ps(SIN_1)), z), _mm_set1_ps(SIN_0));
+        __m128 s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, z), ps));
+        __m128 pc = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_2), z), _mm_set1_ps(COS_1)), z), _mm_set1_ps(COS_0));
+        __m128 c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_mul_ps(_mm_mul_ps(z, z), pc));
+        __m128i j = _mm_add_epi32(q, _mm_set1_epi32(quadrant));
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        __m128 negate = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), 30));
+        __m128 v = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+        _mm_storeu_ps(out+i, _mm_xor_ps(v, negate));
+    }
+    sincos_kernel_scalar(in+i, out+i, n-i, quadrant);
+}
+
+__attribute__((target("sse2")))
+void round_kernel_sse2(const float* in, float* out, int n) {
+    int i;
+    __m128 one = _mm_set1_ps(1.0f);
+    for (i=0; i+4<=n; i+=4) {
+        __m128 x = _mm_loadu_ps(in+i);
+        __m128 exact = _mm_cmpnlt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), x), _mm_set1_ps(ROUND_EXACT));
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x)), d = _mm_sub_ps(x, t);
+        __m128 up = _mm_and_ps(_mm_cmpge_ps(d, _mm_set1_ps(0.5f)), one), down = _mm_and_ps(_mm_cmple_ps(d, _mm_set1_ps(-0.5f)), one);
+        t = _mm_sub_ps(_mm_add_ps(t, up), down);
+        _mm_storeu_ps(out+i, _mm_or_ps(_mm_and_ps(exact, x), _mm_andnot_ps(exact, t)));
+    }
+    round_kernel_scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("sse2")))
+void ftoi_kernel_sse2(const float* in, int* out, int n) {
+    int i;
+    for (i=0; i+4<=n; i+=4) {
+        /* the conversion gives G_MININT outside the range of int, which becomes G_MAXINT above it and 0 for NaN */
+        __m128 x = _mm_loadu_ps(in+i);
+        __m128i over = _mm_castps_si128(_mm_cmpge_ps(x, _mm_set1_ps(FTOI_LIMIT))), nan = _mm_castps_si128(_mm_cmpunord_ps(x, x));
+        _mm_storeu_si128((__m128i*)(out+i), _mm_andnot_si128(nan, _mm_xor_si128(_mm_cvttps_epi32(x), over)));
+    }
+    ftoi_kernel_scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("sse2")))
+void itof_kernel_sse2(const int* in, float* out, int n) {
+    int i;
+    for (i=0; i+4<=n; i+=4)
+        _mm_storeu_ps(out+i, _mm_cvtepi32_ps(_mm_loadu_si128((__m128i*)(in+i))));
+    itof_kernel_scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("sse2")))
+void clamp_kernel_sse2(const float* in, float* out, int n, float lo, float hi) {
+    int i;
+    __m128 l = _mm_set1_ps(lo), h = _mm_set1_ps(hi);
+    for (i=0; i+4<=n; i+=4)
+        _mm_storeu_ps(out+i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in+i), l), h));
+    clamp_kernel_scalar(in+i, out+i, n-i, lo, hi);
+}
+
+__attribute__((target("sse2")))
+void affine_kernel_sse2(const float* in, float* out, int n, float scale, float offset) {
+    int i;
+    __m128 sc = _mm_set1_ps(scale), of = _mm_set1_ps(offset);
+    for (i=0; i+4<=n; i+=4)
+        _mm_storeu_ps(out+i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in+i), sc), of));
+    affine_kernel_scalar(in+i, out+i, n-i, scale, offset);
+}
+
+__attribute__((target("avx2")))
+void sincos_kernel_avx2(const float* in, float* out, int n, int quadrant) {
+    int i;
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    for (i=0; i+8<=n; i+=8) {
+        __m256 x = _mm256_loadu_ps(in+i);
+        if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, x), _mm256_set1_ps(SINCOS_REDUCIBLE), _CMP_NLE_UQ)) != 0) {
+            sincos_kernel_scalar(in+i, out+i, 8, quadrant);
+            continue;
+        }
+
+        __m256 half = _mm256_or_ps(_mm256_and_ps(x, sign), _mm256_set1_ps(0.5f));
+        __m256i q = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)), half));
+        __m256 y = _mm256_cvtepi32_ps(q);
+        __m256 r = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PIO2_1))), _mm256_mul_ps(y, _mm256_set1_ps(PIO2_2))), _mm256_mul_ps(y, _mm256_set1_ps(PIO2_3)));
+        __m256 z = _mm256_mul_ps(r, r);
+        __m256 ps = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_2), z), _mm256_set1_ps(SIN_1)), z), _mm256_set1_ps(SIN_0));
+        __m256 s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, z), ps));
+        __m256 pc = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_2), z), _mm256_set1_ps(COS_1)), z), _mm256_set1_ps(COS_0));
+        __m256 c = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_mul_ps(_mm256_mul_ps(z, z), pc));
+        __m256i j = _mm256_add_epi32(q, _mm256_set1_epi32(quadrant));
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+        __m256 negate = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), 30));
+        __m256 v = _mm256_blendv_ps(s, c, swap);
+        _mm256_storeu_ps(out+i, _mm256_xor_ps(v, negate));
+    }
+    sincos_kernel_scalar(in+i, out+i, n-i, quadrant);
+}
+
+__attribute__((target("avx2")))
+void round_kernel_avx2(const float* in, float* out, int n) {
+    int i;
+    __m256 one = _mm256_set1_ps(1.0f);
+    for (i=0; i+8<=n; i+=8) {
+        __m256 x = _mm256_loadu_ps(in+i);
+        __m256 exact = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), x), _mm256_set1_ps(ROUND_EXACT), _CMP_NLT_UQ);
+        __m256 t = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(x)), d = _mm256_sub_ps(x, t);
+        __m256 up = _mm256_and_ps(_mm256_cmp_ps(d, _mm256_set1_ps(0.5f), _CMP_GE_OQ), one);
+        __m256 down = _mm256_and_ps(_mm256_cmp_ps(d, _mm256_set1_ps(-0.5f), _CMP_LE_OQ), one);
+        t = _mm256_sub_ps(_mm256_add_ps(t, up), down);
+        _mm256_storeu_ps(out+i, _mm256_blendv_ps(t, x, exact));
+    }
+    round_kernel_scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("avx2")))
+void ftoi_kernel_avx2(const float* in, int* out, int n) {
+    int i;
+    for (i=0; i+8<=n; i+=8) {
+        __m256 x = _mm256_loadu_ps(in+i);
+        __m256i over = _mm256_castps_si256(_mm256_cmp_ps(x, _mm256_set1_ps(FTOI_LIMIT), _CMP_GE_OQ));
+        __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+        _mm256_storeu_si256((__m256i*)(out+i), _mm256_andnot_si256(nan, _mm256_xor_si256(_mm256_cvttps_epi32(x), over)));
+    }
+    ftoi_kernel_scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("avx2")))
+void itof_kernel_avx2(const int* in, float* out, int n) {
+    int i;
+    for (i=0; i+8<=n; i+=8)
+        _mm256_storeu_ps(out+i, _mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i*)(in+i))));
+    itof_kernel_scalar(in+i, out+i, n-i);
+}
+
+__attribute__((target("avx2")))
+void clamp_kernel_avx2(const float* in, float* out, int n, float lo, float hi) {
+    int i;
+    __m256 l = _mm256_set1_ps(lo), h = _mm256_set1_ps(hi);
+    for (i=0; i+8<=n; i+=8)
+        _mm256_storeu_ps(out+i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in+i), l), h));
+    clamp_kernel_scalar(in+i, out+i, n-i, lo, hi);
+}
+
+__attribute__((target("avx2")))
+void affine_kernel_avx2(const float* in, float* out, int n, float scale, float offset) {
+    int i;
+    __m256 sc = _mm256_set1_ps(scale), of = _mm256_set1_ps(offset);
+    for (i=0; i+8<=n; i+=8)
+        _mm256_storeu_ps(out+i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in+i), sc), of));
+    affine_kernel_scalar(in+i, out+i, n-i, scale, offset);
+}
+
+#endif
+
+/* the best kernels this cpu supports */
+const TransformKernels* transform_kernels() {
+    static const TransformKernels k[CPU_LEVELS] = {
+        { sincos_kernel_scalar, round_kernel_scalar, ftoi_kernel_scalar, itof_kernel_scalar, clamp_kernel_scalar, affine_kernel_scalar },
+#ifdef ANIM_X86_SIMD
+        { sincos_kernel_sse2, round_kernel_sse2, ftoi_kernel_sse2, itof_kernel_sse2, clamp_kernel_sse2, affine_kernel_sse2 },
+        { sincos_kernel_avx2, round_kernel_avx2, ftoi_kernel_avx2, itof_kernel_avx2, clamp_kernel_avx2, affine_kernel_avx2 }
+#endif
+    };
+
+    return &k[cpu_level()];
+}
+
+void transformv_sin(const float* in, float* out, int n) {
+    transform_kernels()->sincos(in, out, n, 0);
+}
+
+void transformv_cos(const float* in, float* out, int n) {
+    transform_kernels()->sincos(in, out, n, 1);
+}
+
+void transformv_round(const float* in, float* out, int n) {
+    transform_kernels()->round(in, out, n);
+}
+
+void transformv_ftoi(const float* in, int* out, int n) {
+    transform_kernels()->ftoi(in, out, n);
+}
+
+void transformv_itof(const int* in, float* out, int n) {
+    transform_kernels()->itof(in, out, n);
+}
+
+/* clamp and affine take two parameters, kept in the derived value */
+
+void concrete_derived_value_update_clamp(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    transform_kernels()->clamp(cdv->in, cdv->out, cdv->n, cdv->a, cdv->b);
+}
+
+void concrete_derived_value_update_affine(DerivedValue* dv) {
+    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
+    transform_kernels()->affine(cdv->in, cdv->out, cdv->n, cdv->a, cdv->b);
+}
+
+DerivedValue* mapderive_clamp(int n, float* in, float* out, float lo, float hi) {
+    g_assert_cmpfloat(lo, <=, hi);
+    ConcreteDerivedValue* cdv = (ConcreteDerivedValue*)mk_cdv(concrete_derived_value_update_clamp, NULL, n, in, out, sizeof(float), sizeof(float));
+    cdv->a = lo;
+    cdv->b = hi;
+    return (DerivedValue*)cdv;
+}
+
+DerivedValue* mapderive_affine(int n, float* in, float* out, float scale, float offset) {
+    ConcreteDerivedValue* cdv = (ConcreteDerivedValue*)mk_cdv(concrete_derived_value_update_affine, NULL, n, in, out, sizeof(float), sizeof(float));
+    cdv->a = scale;
+    cdv->b = offset;
+    return (DerivedValue*)cdv;
+}
+
+/* derived value graphs - the derived values attached to an animation, kept in dependency order.  a value that reads
+ * bytes another writes comes after it, and otherwise values keep the order they were attached in.  each value keeps a
+ * copy of its inputs, and is only recomputed when they differ from the copy.  values whose inputs are not known (those
+ * made by derive) are recomputed on every update, and keep their place relative to every other value.
+ */
+
+typedef struct DerivedAnimationStruct {
     Animation a;
     Animation* child;
-    TimeTransform* t;
-} TransformedAnimation;
+    int n;
+    DerivedValue** dvs;   /* in dependency order */
+    char** shadows;       /* per value, its inputs as of its last update */
+    gboolean fresh;       /* nothing has been computed yet */
+} DerivedAnimation;
+
+gboolean derived_value_overlap(const char* p, int np, const char* q, int nq) {
+    return p < q + nq && q < p + np;
+}
+
+/* whether b must be computed after a, which was attached before it */
+gboolean derived_value_depends(DerivedValue* a, DerivedValue* b) {
+    if (a->in_bytes == 0 || b->in_bytes == 0)
+        return TRUE;
+
+    return derived_value_overlap(b->in, b->in_bytes, a->out, a->out_bytes);
+}
+
+/* order dvs with Kahn's algorithm, taking the earliest attached value that is ready each time */
+void derived_values_sort(DerivedValue** dvs, int n) {
+    int i, j, k;
+    int* waiting = calloc(n, sizeof(int));  /* how many unplaced values each value waits for */
+    gboolean* placed = calloc(n, sizeof(gboolean));
+    DerivedValue** sorted = malloc(sizeof(DerivedValue*) * n);
+
+    for (i=0; i<n; i++)
+        for (j=0; j<n; j++)
+            if (i != j && derived_value_depends(dvs[i], dvs[j]) && (i < j || !derived_value_depends(dvs[j], dvs[i])))
+                waiting[j]++;
+
+    for (k=0; k<n; k++) {
+        /* if every remaining value waits on another there is a cycle: take the earliest attached */
+        for (i=0; i<n && (placed[i] || waiting[i] > 0); i++)
+            ;
+        if (i == n)
+            for (i=0; placed[i]; i++)
+                ;
+
+        placed[i] = TRUE;
+        sorted[k] = dvs[i];
+        for (j=0; j<n; j++)
+            if (!placed[j] && derived_value_depends(dvs[i], dvs[j]) && (i < j || !derived_value_depends(dvs[j], dvs[i])))
+                waiting[j]--;
+    }
+
+    memcpy(dvs, sorted, sizeof(DerivedValue*) * n);
+    free(sorted);
+    free(placed);
+    free(waiting);
+}
+
+void derived_animation_update(Animation* a, float f) {
+    DerivedAnimation* da = (DerivedAnimation*)a;
+    int i;
+
+    if (a->shared)
+        animation_mark_stale(da->child);
+    animation_update_child(a, da->child, f);
+
+    for (i=0; i<da->n; i++) {
+        DerivedValue* dv = da->dvs[i];
+
+        if (dv->in_bytes > 0) {
+            if (!da->fresh && memcmp(da->shadows[i], dv->in, dv->in_bytes) == 0)
+                continue;
+            memcpy(da->shadows[i], dv->in, dv->in_bytes);
+        }
+
+        dv->update(dv);
+    }
+
+    da->fresh = FALSE;
+}
+
+void derived_animation_free(Animation* a) {
+    DerivedAnimation* da = (DerivedAnimation*)a;
+    int i;
+    for (i=0; i<da->n; i++) {
+        derived_value_free(da->dvs[i]);
+        free(da->shadows[i]);
+    }
+    free(da->dvs);
+    free(da->shadows);
+    animation_free(da->child);
+    default_animation_free(a);
+}
+
+float derived_animation_duration(Animation* a) {
+    DerivedAnimation* da = (DerivedAnimation*)a;
+    return animation_duration(da->child);
+}
+
+void derived_animation_visit(Animation* a, AnimationVisitor visitor, void* data) {
+    DerivedAnimation* da = (DerivedAnimation*)a;
+    visitor(da->child, data);
+}
+
+Animation* attachv(Animation* a, DerivedValue** dvs, int n) {
+    g_assert(a != NULL);
+    g_assert_cmpint(n, >, 0);
+
+    int i;
+    animation_adopt_child(a);
+    for (i=0; i<n; i++) {
+        g_assert(dvs[i] != NULL);
+        if (dvs[i]->arena == NULL)
+            animation_adopt(dvs[i], derived_value_free_adopted);
+    }
+
+    DerivedAnimation* da = animation_alloc(sizeof(DerivedAnimation));
+    da->child   = a;
+    da->n       = n;
+    da->dvs     = animation_alloc(sizeof(DerivedValue*) * n);
+    da->shadows = animation_alloc(sizeof(char*) * n);
+    da->fresh   = TRUE;
+
+    memcpy(da->dvs, dvs, sizeof(DerivedValue*) * n);
+    derived_values_sort(da->dvs, n);
+    for (i=0; i<n; i++)
+        da->shadows[i] = animation_alloc(da->dvs[i]->in_bytes);
+
+    animation_init(&da->a, ANIMATION_DERIVED, derived_animation_update, derived_animation_duration, derived_animation_free, derived_animation_visit);
+    return (Animation*)da;
+}
+
+Animation* attach(Animation* a, DerivedValue *dv) {
+    return attachv(a, &dv, 1);
+}
+
+Animation* attachn(Animation *a, DerivedValue *dv1, ...) {
+    GPtrArray* dvs = g_ptr_array_new();
+    g_ptr_array_add(dvs, dv1);
+
+    va_list args;
+    va_start(args, dv1);
+    while (TRUE) {
+        DerivedValue* dv = va_arg(args, DerivedValue*);
+        if (dv == NULL)
+            break;
+        g_ptr_array_add(dvs, dv);
+    }
+    va_end(args);
+
+    Animation* result = attachv(a, (DerivedValue**)dvs->pdata, dvs->len);
+    g_ptr_array_free(dvs, TRUE);
+    return result;
+}
+
+/* targets - the values a subtree writes, for finding children that write the same values.  a node that may write values
+ * it cannot list (a derive with unknown sizes, a baked animation or an image) is taken to write everything.
+ */
+
+typedef struct TargetsStruct {
+    GArray* ranges;          /* pairs of a start and an end */
+    gboolean everything;
+    gboolean static_only;    /* only the values written by static nodes */
+} Targets;
+
+void targets_add(Targets* t, const void* p, int bytes) {
+    const char* range[2];
+    if (bytes <= 0) {
+        t->everything = TRUE;
+        return;
+    }
+
+    range[0] = p;
+    range[1] = (const char*)p + bytes;
+    g_array_append_vals(t->ranges, range, 2);
+}
+
+void targets_visitor(Animation* a, void* data) {
+    Targets* t = data;
+    int i;
+
+    if (t->static_only && !a->has_static)
+        return;
+
+    if (!t->static_only || a->is_static) {
+        switch (a->kind) {
+        case ANIMATION_LINEARF:
+            targets_add(t, ((LinearAnimationF*)a)->v, sizeof(float) * ((LinearAnimationF*)a)->n);
+            break;
+        case ANIMATION_LINEARI:
+            targets_add(t, ((LinearAnimationI*)a)->v, sizeof(int) * ((LinearAnimationI*)a)->n);
+            break;
+        case ANIMATION_BEZIERF:
+            targets_add(t, ((BezierAnimationF*)a)->v, sizeof(float) * ((BezierAnimationF*)a)->n);
+            break;
+        case ANIMATION_SPLINEF:
+            targets_add(t, ((SplineAnimationF*)a)->v, sizeof(float) * ((SplineAnimationF*)a)->n);
+            break;
+        case ANIMATION_KEYFRAMESF:
+            targets_add(t, ((KeyframeAnimationF*)a)->v, sizeof(float) * ((KeyframeAnimationF*)a)->n);
+            break;
+        case ANIMATION_DERIVED:
+            for (i=0; i<((DerivedAnimation*)a)->n; i++)
+                targets_add(t, ((DerivedAnimation*)a)->dvs[i]->out, ((DerivedAnimation*)a)->dvs[i]->out_bytes);
+            break;
+        case ANIMATION_NULL:
+        case ANIMATION_SCALED:
+        case ANIMATION_TRANSFORMED:
+        case ANIMATION_SEQUENCE:
+        case ANIMATION_FLAT_SEQUENCE:
+        case ANIMATION_PARALLEL:
+        case ANIMATION_COMPILED:
+            break;
+        default:
+            t->everything = TRUE;
+            break;
+        }
+    }
+
+    a->visit(a, targets_visitor, t);
+}
+
+Targets targets_new(gboolean static_only) {
+    Targets t;
+    t.ranges      = g_array_new(FALSE, FALSE, sizeof(const char*));
+    t.everything  = FALSE;
+    t.static_only = static_only;
+    return t;
+}
+
+gboolean targets_overlap(Targets* t, Targets* u) {
+    const char** p = (const char**)t->ranges->data;
+    const char** q = (const char**)u->ranges->data;
+    int i, j;
+
+    if (t->everything && (u->everything || u->ranges->len > 0))
+        return TRUE;
+    if (u->everything && t->ranges->len > 0)
+        return TRUE;
+
+    for (i=0; i<t->ranges->len; i+=2)
+        for (j=0; j<u->ranges->len; j+=2)
+            if (p[i] < q[j+1] && q[j] < p[i+1])
+                return TRUE;
+
+    return FALSE;
+}
+
+/* whether something the static nodes under a write is also written by b */
+gboolean static_targets_overlap(Animation* a, Targets* b) {
+    Targets t = targets_new(TRUE);
+    targets_visitor(a, &t);
+    gboolean overlap = targets_overlap(&t, b);
+    g_array_free(t.ranges, TRUE);
+    return overlap;
+}
+
+gboolean animation_shares_targets(Animation* a) {
+    Targets t = targets_new(FALSE);
+    gboolean shared = FALSE;
+    int i;
+
+    if (a->kind == ANIMATION_PARALLEL) {
+        ParallelAnimation* pa = (ParallelAnimation*)a;
+        if (pa->a1->has_static) {
+            targets_visitor(pa->a2, &t);
+            shared = static_targets_overlap(pa->a1, &t);
+        }
+        if (!shared && pa->a2->has_static) {
+            g_array_set_size(t.ranges, 0);
+            t.everything = FALSE;
+            targets_visitor(pa->a1, &t);
+            shared = static_targets_overlap(pa->a2, &t);
+        }
+    } else if (a->kind == ANIMATION_DERIVED) {
+        DerivedAnimation* da = (DerivedAnimation*)a;
+        for (i=0; i<da->n; i++)
+            targets_add(&t, da->dvs[i]->out, da->dvs[i]->out_bytes);
+        shared = static_targets_overlap(da->child, &t);
+    }
+
+    g_array_free(t.ranges, TRUE);
+    return shared;
+}
+
+/* sealing - check once what animation_update would otherwise check at every node on every update */
+
+#define SEAL_TRANSFORM_SAMPLES 64
+
+void animation_seal_visitor(Animation* a, void* data) {
+    g_assert(a != NULL);
+    animation_seal(a);
+}
+
+void animation_seal(Animation* a) {
+    g_assert(a != NULL);
+
+    if (a->sealed)
+        return;
+
+    a->visit(a, animation_seal_visitor, NULL);
+
+    /* a tree changed without animation_invalidate would pass its children the wrong times */
+    g_assert_cmpfloat(a->cached_duration, ==, a->duration(a));
+
+    int i;
+    switch (a->kind) {
+    case ANIMATION_SCALED:
+        g_assert_cmpfloat(((ScaledAnimation*)a)->scale_factor, >, 0.0);
+        break;
+
+    case ANIMATION_TRANSFORMED: {
+        /* the transformation must map [0, 1] into [0, 1], which is checked at evenly spaced samples */
+        TransformedAnimation* ta = (TransformedAnimation*)a;
+        g_assert(ta->t != NULL);
+        g_assert_cmpfloat(ta->child->cached_duration, >, 0.0);
+        for (i=0; i<=SEAL_TRANSFORM_SAMPLES; i++)
+            assert_rangef(apply_transform(ta->t, (float)i / SEAL_TRANSFORM_SAMPLES), 0.0, 1.0);
+        break;
+    }
+
+    case ANIMATION_PARALLEL: {
+        ParallelAnimation* pa = (ParallelAnimation*)a;
+        g_assert_cmpfloat(pa->a1->cached_duration, ==, pa->a2->cached_duration);
+        break;
+    }
+
+    case ANIMATION_DERIVED:
+        g_assert_cmpint(((DerivedAnimation*)a)->n, >, 0);
+        break;
+
+    default:
+        break;
+    }
+
+    /* static nodes start skipping from here, having written nothing yet */
+    a->written = a->is_null;
+    a->sealed  = TRUE;
+}
+
+/* optimization - rewrite a tree into an equivalent one with fewer nodes.
+ *
+ * Scale factors are moved out through time transforms, which commute with them, and nested scales multiply.  Nested
+ * time transforms become one chained transform, nested sequences one flat sequence, and each run of sequence children
+ * that write nothing a single null animation.  Parallel children that write nothing are dropped.
+ *
+ * Heap nodes are rewritten in place where they can be, and otherwise replaced by new heap nodes.  Nodes allocated from
+ * an arena, and everything beneath them, are left as they are.
+ */
+
+Animation* mk_null(float d) {
+    return (d == 1.0) ? null_animation() : scale(null_animation(), d);
+}
+
+gboolean optimize_is_null(Animation* a) {
+    return a->kind == ANIMATION_NULL || (a->kind == ANIMATION_SCALED && ((ScaledAnimation*)a)->child->kind == ANIMATION_NULL);
+}
+
+/* whether a is a heap node of the given kind, which the optimizer may take apart */
+gboolean optimize_fusible(Animation* a, AnimationKind kind) {
+    return a->arena == NULL && a->kind == kind;
+}
+
+/* free a heap node whose children have been taken from it */
+void optimize_free_node(Animation* a) {
+    if (a->kind == ANIMATION_FLAT_SEQUENCE) {
+        FlatSequenceAnimation* fa = (FlatSequenceAnimation*)a;
+        free(fa->children);
+        free(fa->starts);
+    }
+    default_animation_free(a);
+}
+
+Animation* optimize_node(Animation* a);
+
+/* fold a scaled child into a scaled node, whose child is already optimized */
+Animation* optimize_scaled(ScaledAnimation* sa) {
+    Animation* child = sa->child;
+
+    if (optimize_fusible(child, ANIMATION_SCALED)) {
+        ScaledAnimation* inner = (ScaledAnimation*)child;
+        sa->scale_factor *= inner->scale_factor;
+        sa->child = inner->child;
+        optimize_free_node(child);
+    }
+
+    if (sa->scale_factor == 1.0) {
+        child = sa->child;
+        optimize_free_node((Animation*)sa);
+        return child;
+    }
+
+    return (Animation*)sa;
+}
+
+/* fold a transformed child into a transformed node, whose child is already optimized */
+Animation* optimize_transformed(TransformedAnimation* ta) {
+    Animation* child = ta->child;
+
+    /* transform(scale(a, s), t) is scale(transform(a, t), s), as transforms work in time relative to the duration */
+    if (optimize_fusible(child, ANIMATION_SCALED)) {
+        ScaledAnimation* sa = (ScaledAnimation*)child;
+        ta->child = sa->child;
+        sa->child = optimize_transformed(ta);
+        return optimize_scaled(sa);
+    }
+
+    if (optimize_fusible(child, ANIMATION_TRANSFORMED)) {
+        TransformedAnimation* inner = (TransformedAnimation*)child;
+        TimeTransform* t = chain_transforms(ta->t, inner->t);
+        ta->child = inner->child;
+        optimize_free_node(child);
+
+        if (t == NULL) {
+            child = ta->child;
+            optimize_free_node((Animation*)ta);
+            return child;
+        }
+
+        ta->t = t;
+        return (Animation*)ta;
+    }
+
+    if (ta->t->f == identity_transform_function) {
+        time_transform_free(ta->t);
+        optimize_free_node((Animation*)ta);
+        return child;
+    }
+
+    return (Animation*)ta;
+}
+
+/* flatten a sequence's optimized children into one list, merging runs of nulls */
+Animation* optimize_sequence(Animation* a, Animation** children, int n) {
+    GPtrArray* flat = g_ptr_array_new();
+    GPtrArray* merged = g_ptr_array_new();
+    int i, j;
+
+    for (i=0; i<n; i++) {
+        Animation* c = optimize_node(children[i]);
+        if (optimize_fusible(c, ANIMATION_FLAT_SEQUENCE)) {
+            FlatSequenceAnimation* fa = (FlatSequenceAnimation*)c;
+            for (j=0; j<fa->n; j++)
+                g_ptr_array_add(flat, fa->children[j]);
+            optimize_free_node(c);
+        } else {
+            g_ptr_array_add(flat, c);
+        }
+    }
+
+    for (i=0; i<flat->len; i=j) {
+        Animation* c = g_ptr_array_index(flat, i);
+        float d = 0.0;
+
+        if (!c->is_null) {
+            g_ptr_array_add(merged, c);
+            j = i+1;
+            continue;
+        }
+
+        for (j=i; j<flat->len && ((Animation*)g_ptr_array_index(flat, j))->is_null; j++)
+            d += animation_duration(g_ptr_array_index(flat, j));
+
+        /* a run that takes no time is dropped, unless it is all there is.  a run of one is already a null animation */
+        if (d > 0.0 && j > i+1)
+            g_ptr_array_add(merged, mk_null(d));
+        else if (d > 0.0 || (i == 0 && j == flat->len))
+            g_ptr_array_add(merged, g_ptr_array_index(flat, i++));
+
+        for (; i<j; i++)
+            animation_free(g_ptr_array_index(flat, i));
+    }
+
+    optimize_free_node(a);
+    Animation* result = (merged->len == 1) ? g_ptr_array_index(merged, 0) : sequencev((Animation**)merged->pdata, merged->len);
+
+    g_ptr_array_free(flat, TRUE);
+    g_ptr_array_free(merged, TRUE);
+    return result;
+}
+
+/* optimize a, returning its replacement */
+Animation* optimize_node(Animation* a) {
+    if (a->arena != NULL)
+        return a;
+
+    /* anything that writes nothing is a null animation of the same duration.  derived nodes are never null, as they
+     * write their values whatever their child does */
+    if (a->is_null && !optimize_is_null(a) && a->cached_duration > 0.0) {
+        float d = a->cached_duration;
+        animation_free(a);
+        return mk_null(d);
+    }
+
+    switch (a->kind) {
+    case ANIMATION_SCALED: {
+        ScaledAnimation* sa = (ScaledAnimation*)a;
+        sa->child = optimize_node(sa->child);
+        return optimize_scaled(sa);
+    }
+
+    case ANIMATION_TRANSFORMED: {
+        TransformedAnimation* ta = (TransformedAnimation*)a;
+        ta->child = optimize_node(ta->child);
+        return optimize_transformed(ta);
+    }
+
+    case ANIMATION_SEQUENCE: {
+        SequenceAnimation* sa = (SequenceAnimation*)a;
+        Animation* children[2];
+        children[0] = sa->a1;
+        children[1] = sa->a2;
+        return optimize_sequence(a, children, 2);
+    }
+
+    case ANIMATION_FLAT_SEQUENCE: {
+        FlatSequenceAnimation* fa = (FlatSequenceAnimation*)a;
+        Animation** children = fa->children;
+        fa->children = NULL;
+        Animation* result = optimize_sequence(a, children, fa->n);
+        free(children);
+        return result;
+    }
+
+    case ANIMATION_PARALLEL: {
+        ParallelAnimation* pa = (ParallelAnimation*)a;
+        Animation *a1 = optimize_node(pa->a1), *a2 = optimize_node(pa->a2);
+
+        /* the children last equally long, so one that writes nothing can go */
+        if (a1->is_null || a2->is_null) {
+            optimize_free_node(a);
+            if (a2->is_null) {
+                animation_free(a2);
+                return a1;
+            }
+            animation_free(a1);
+            return a2;
+        }
+
+        pa->a1 = a1;
+        pa->a2 = a2;
+        return a;
+    }
+
+    case ANIMATION_DERIVED: {
+        DerivedAnimation* da = (DerivedAnimation*)a;
+        da->child = optimize_node(da->child);
+        return a;
+    }
+
+    default:
+        return a;
+    }
+}
+
+Animation* animation_optimize(Animation* a) {
+    g_assert(a != NULL);
+
+    /* replacement nodes come from the heap, like the nodes they replace */
+    AnimationArena* arena = current_arena();
+    set_current_arena(NULL);
+    Animation* result = optimize_node(a);
+    set_current_arena(arena);
+
+    animation_invalidate(result);
+    return result;
+}
+
+/* compiled animation - a tree lowered into a flat program.
+ *
+ * Scale factors and sequence offsets are folded into each instruction's affine time mapping, so only sequences
+ * and time transforms need instructions of their own.  Each of those writes the local time of its child into a
+ * time register, which the instructions beneath it read.  A select jumps to the instructions of the active
+ * sequence child, each of which ends with a jump past its siblings.
+ */
+
+typedef enum {
+    OP_JUMP,      /* continue at u.jump */
+    OP_SELECT,    /* pick the active sequence child, write its parent's local time to u.select.out and jump to it */
+    OP_TRANSFORM, /* write the transformed local time to u.transform.out */
+    OP_LINEARF,   /* inlined linearf */
+    OP_LINEARI,   /* inlined lineari */
+    OP_LEAF,      /* update any other node at its local time */
+    OP_DERIVE     /* update a derived value */
+} AnimationOp;
+
+typedef struct AnimationInstructionStruct {
+    AnimationOp op;
+    int frame;          /* the time register the instruction reads */
+    float offset, rate; /* local time = (time[frame] - offset) * rate */
+    float duration;     /* local time is clamped to [0, duration] */
+    union {
+        int jump;
+        struct { int out; int n; int first; int cursor; } select; /* entries first .. first+n-1 of the select tables */
+        struct { int out; TimeTransform* t; } transform;
+        struct { void* v; void* start; void* end; int n; void* kernel; } linear;
+        Animation* leaf;
+        DerivedValue* dv;
+    } u;
+} AnimationInstruction;
+
+typedef struct CompiledAnimationStruct {
+    Animation a;
+    Animation* source;
+    int n;                            /* instructions */
+    AnimationInstruction* program;
+    int nentries;                     /* select table entries */
+    float* ends;                      /* end of each sequence child, in its sequence's local time */
+    int* targets;                     /* first instruction of each sequence child */
+    int nregisters;
+    float* registers;
+} CompiledAnimation;
+
+typedef struct AnimationCompilerStruct {
+    GArray* program;
+    GArray* ends;
+    GArray* targets;
+    int nregisters;
+} AnimationCompiler;
+
+AnimationInstruction* compiler_emit(AnimationCompiler* c, AnimationOp op, int frame, float offset, float rate, float duration) {
+    AnimationInstruction in;
+    memset(&in, 0, sizeof(in));
+    in.op       = op;
+    in.frame    = frame;
+    in.offset   = offset;
+    in.rate     = rate;
+    in.duration = duration;
+    g_array_append_val(c->program, in);
+    return &g_array_index(c->program, AnimationInstruction, c->program->len - 1);
+}
+
+void compile_node(AnimationCompiler* c, Animation* a, int frame, float offset, float rate);
+
+/* emit a select over n children, with starts[i] the local start time of child i */
+void compile_select(AnimationCompiler* c, Animation** children, float* starts, int n, int frame, float offset, float rate, float duration) {
+    int i, out = c->nregisters++, first = c->ends->len;
+    int* jumps = malloc(sizeof(int) * n);
+
+    AnimationInstruction* in = compiler_emit(c, OP_SELECT, frame, offset, rate, duration);
+    in->u.select.out    = out;
+    in->u.select.n      = n;
+    in->u.select.first  = first;
+    in->u.select.cursor = 0;
+
+    /* reserve this select's entries before any nested select claims its own */
+    g_array_set_size(c->ends, first + n);
+    g_array_set_size(c->targets, first + n);
+
+    for (i=0; i<n; i++) {
+        g_array_index(c->ends, float, first + i) = starts[i] + animation_duration(children[i]);
+        g_array_index(c->targets, int, first + i) = c->program->len;
+
+        compile_node(c, children[i], out, starts[i], 1.0);
+
+        jumps[i] = c->program->len;
+        if (i < n-1)
+            compiler_emit(c, OP_JUMP, out, 0.0, 1.0, 0.0);
+    }
+
+    for (i=0; i<n-1; i++)
+        g_array_index(c->program, AnimationInstruction, jumps[i]).u.jump = c->program->len;
+
+    free(jumps);
+}
+
+void compile_node(AnimationCompiler* c, Animation* a, int frame, float offset, float rate) {
+    AnimationInstruction* in;
+    float d = animation_duration(a);
+
+    switch (a->kind) {
+    case ANIMATION_NULL:
+        break;
+
+    case ANIMATION_SCALED: {
+        ScaledAnimation* sa = (ScaledAnimation*)a;
+        compile_node(c, sa->child, frame, offset, rate / sa->scale_factor);
+        break;
+    }
+
+    case ANIMATION_PARALLEL: {
+        ParallelAnimation* pa = (ParallelAnimation*)a;
+        compile_node(c, pa->a1, frame, offset, rate);
+        compile_node(c, pa->a2, frame, offset, rate);
+        break;
+    }
+
+    case ANIMATION_SEQUENCE: {
+        SequenceAnimation* sa = (SequenceAnimation*)a;
+        Animation* children[2];
+        float starts[2];
+        children[0] = sa->a1; starts[0] = 0.0;
+        children[1] = sa->a2; starts[1] = animation_duration(sa->a1);
+        compile_select(c, children, starts, 2, frame, offset, rate, d);
+        break;
+    }
+
+    case ANIMATION_FLAT_SEQUENCE: {
+        FlatSequenceAnimation* fa = (FlatSequenceAnimation*)a;
+        compile_select(c, fa->children, fa->starts, fa->n, frame, offset, rate, d);
+        break;
+    }
+
+    case ANIMATION_TRANSFORMED: {
+        TransformedAnimation* ta = (TransformedAnimation*)a;
+        int out = c->nregisters++;
+        in = compiler_emit(c, OP_TRANSFORM, frame, offset, rate, d);
+        in->u.transform.out = out;
+        in->u.transform.t   = ta->t;
+        compile_node(c, ta->child, out, 0.0, 1.0);
+        break;
+    }
+
+    case ANIMATION_DERIVED: {
+        /* compiled derived values are recomputed on every update, in dependency order */
+        DerivedAnimation* da = (DerivedAnimation*)a;
+        int i;
+        compile_node(c, da->child, frame, offset, rate);
+        for (i=0; i<da->n; i++) {
+            in = compiler_emit(c, OP_DERIVE, frame, offset, rate, d);
+            in->u.dv = da->dvs[i];
+        }
+        break;
+    }
+
+    case ANIMATION_LINEARF: {
+        LinearAnimationF* la = (LinearAnimationF*)a;
+        in = compiler_emit(c, OP_LINEARF, frame, offset, rate, d);
+        in->u.linear.v      = la->v;
+        in->u.linear.start  = la->start;
+        in->u.linear.end    = la->end;
+        in->u.linear.n      = la->n;
+        in->u.linear.kernel = la->kernel;
+        break;
+    }
+
+    case ANIMATION_LINEARI: {
+        LinearAnimationI* la = (LinearAnimationI*)a;
+        in = compiler_emit(c, OP_LINEARI, frame, offset, rate, d);
+        in->u.linear.v      = la->v;
+        in->u.linear.start  = la->start;
+        in->u.linear.end    = la->end;
+        in->u.linear.n      = la->n;
+        in->u.linear.kernel = la->kernel;
+        break;
+    }
+
+    default:
+        in = compiler_emit(c, OP_LEAF, frame, offset, rate, d);
+        in->u.leaf = a;
+        break;
+    }
+}
+
+int compiled_animation_select(CompiledAnimation* ca, AnimationInstruction* in, float f) {
+    float* ends = ca->ends + in->u.select.first;
+    int n = in->u.select.n, c = in->u.select.cursor, lo = 0, hi = n - 1;
+
+    /* as with flat sequences, first try the child that was active last time and the one after it */
+    if (f <= ends[c] && (c == 0 || f > ends[c-1]))
+        return c;
+    if (c+1 < n && f <= ends[c+1] && f > ends[c])
+        return c+1;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (f <= ends[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return lo;
+}
 
-void transformed_animation_update(Animation* a, float f) {
-    TransformedAnimation* ta = (TransformedAnimation*)a;
+void compiled_animation_update(Animation* a, float f) {
+    CompiledAnimation* ca = (CompiledAnimation*)a;
+    float* time = ca->registers;
+    int pc = 0;
+
+    time[0] = f;
+    while (pc < ca->n) {
+        AnimationInstruction* in = &ca->program[pc++];
+
+        if (in->op == OP_JUMP) {
+            pc = in->u.jump;
+            continue;
+        }
+
+        if (in->op == OP_DERIVE) {
+            derived_value_update(in->u.dv);
+            continue;
+        }
+
+        float t = (time[in->frame] - in->offset) * in->rate;
+        if (t < 0.0)
+            t = 0.0;
+        if (t > in->duration)
+            t = in->duration;
+
+        int i;
+        switch (in->op) {
+        case OP_SELECT:
+            i = in->u.select.cursor = compiled_animation_select(ca, in, t);
+            time[in->u.select.out] = t;
+            pc = ca->targets[in->u.select.first + i];
+            break;
+
+        case OP_TRANSFORM:
+            time[in->u.transform.out] = (in->duration > 0.0) ? in->u.transform.t->f(in->u.transform.t, t / in->duration) * in->duration : 0.0;
+            break;
+
+        case OP_LINEARF:
+            ((LinearKernelF)in->u.linear.kernel)(in->u.linear.v, in->u.linear.start, in->u.linear.end, in->u.linear.n, t);
+            break;
 
-    float d = animation_duration(ta->child);
-    animation_update(ta->child, apply_transform(ta->t, f / d) * d);
+        case OP_LINEARI:
+            ((LinearKernelI)in->u.linear.kernel)(in->u.linear.v, in->u.linear.start, in->u.linear.end, in->u.linear.n, t);
+            break;
+
+        case OP_LEAF:
+            PROFILE_UPDATE(in->u.leaf, in->u.leaf->update(in->u.leaf, t));
+            break;
+
+        default:
+            g_assert_not_reached();
+        }
+    }
 }
 
-void transformed_animation_free(Animation* a) {
-    TransformedAnimation* ta = (TransformedAnimation*)a;
-    animation_free(ta->child);
-    free(ta->t);
+void compiled_animation_free(Animation* a) {
+    CompiledAnimation* ca = (CompiledAnimation*)a;
+    animation_free(ca->source);
+    g_free(ca->program);
+    g_free(ca->ends);
+    g_free(ca->targets);
+    free(ca->registers);
     default_animation_free(a);
 }
 
-float transformed_animation_duration(Animation* a) {
-    TransformedAnimation* ta = (TransformedAnimation*)a;
-    return animation_duration(ta->child);
+float compiled_animation_duration(Animation* a) {
+    CompiledAnimation* ca = (CompiledAnimation*)a;
+    return animation_duration(ca->source);
 }
 
-Animation* transform(Animation* a, TimeTransform* t) {
+void compiled_animation_visit(Animation* a, AnimationVisitor visitor, void* data) {
+    CompiledAnimation* ca = (CompiledAnimation*)a;
+    visitor(ca->source, data);
+}
+
+Animation* animation_compile(Animation* a) {
     g_assert(a != NULL);
-    g_assert(t != NULL);
 
-    TransformedAnimation* ta = malloc(sizeof(TransformedAnimation));
-    ta->a.update   = transformed_animation_update;
-    ta->a.duration = transformed_animation_duration;
-    ta->a.free     = transformed_animation_free;
-    ta->child = a;
-    ta->t     = t;
-    return (Animation*)ta;
+    AnimationCompiler c;
+    c.program    = g_array_new(FALSE, FALSE, sizeof(AnimationInstruction));
+    c.ends       = g_array_new(FALSE, FALSE, sizeof(float));
+    c.targets    = g_array_new(FALSE, FALSE, sizeof(int));
+    c.nregisters = 1;
+    compile_node(&c, a, 0, 0.0, 1.0);
+
+    animation_adopt_child(a);
+
+    CompiledAnimation* ca = animation_alloc(sizeof(CompiledAnimation));
+    ca->source     = a;
+    ca->n          = c.program->len;
+    ca->program    = (AnimationInstruction*)g_array_free(c.program, FALSE);
+    ca->nentries   = c.ends->len;
+    ca->ends       = (float*)g_array_free(c.ends, FALSE);
+    ca->targets    = (int*)g_array_free(c.targets, FALSE);
+    ca->nregisters = c.nregisters;
+    ca->registers  = animation_alloc(sizeof(float) * c.nregisters);
+    memset(ca->registers, 0, sizeof(float) * c.nregisters);
+    animation_adopt(ca->program, g_free);
+    animation_adopt(ca->ends, g_free);
+    animation_adopt(ca->targets, g_free);
+    animation_init(&ca->a, ANIMATION_COMPILED, compiled_animation_update, compiled_animation_duration, compiled_animation_free, compiled_animation_visit);
+    return (Animation*)ca;
 }
 
-/* sequence animation */
+/* batch sampling
+ *
+ * Trees built only from null, linearf, scale, transform, sequence and parallel nodes are sampled a node at a time:
+ * each node maps the whole batch of times into its children's local times, and each linearf writes its column of
+ * the buffer for every sample it is active in.  Anything else is sampled by updating the tree once per time.
+ */
+
+typedef struct AnimationBatchStruct {
+    float** outputs;
+    const int* sizes;
+    int* columns;     /* buffer column of the first value of each output */
+    int noutputs;
+    float* buffer;
+    int stride;
+    char* written;    /* which buffer entries the tree wrote */
+} AnimationBatch;
+
+void animation_batchable_visitor(Animation* a, void* data);
+
+gboolean animation_batchable(Animation* a) {
+    switch (a->kind) {
+    case ANIMATION_NULL:
+    case ANIMATION_LINEARF:
+        return TRUE;
 
-typedef struct SequenceAnimationStruct {
+    case ANIMATION_SCALED:
+    case ANIMATION_TRANSFORMED:
+    case ANIMATION_SEQUENCE:
+    case ANIMATION_FLAT_SEQUENCE:
+    case ANIMATION_PARALLEL: {
+        gboolean batchable = TRUE;
+        a->visit(a, animation_batchable_visitor, &batchable);
+        return batchable;
+    }
+
+    default:
+        return FALSE;
+    }
+}
+
+void animation_batchable_visitor(Animation* a, void* data) {
+    gboolean* batchable = data;
+    *batchable = *batchable && animation_batchable(a);
+}
+
+void batch_node(AnimationBatch* b, Animation* a, float* times, int* rows, int count);
+
+void batch_child(AnimationBatch* b, Animation* a, float* times, int* rows, int count) {
+    if (count > 0)
+        batch_node(b, a, times, rows, count);
+}
+
+/* the buffer column of the value at p, or -1 if it is in no output the caller asked for */
+int batch_column(AnimationBatch* b, float* p) {
+    int j;
+    for (j=0; j<b->noutputs; j++)
+        if (p >= b->outputs[j] && p < b->outputs[j] + b->sizes[j])
+            return b->columns[j] + (p - b->outputs[j]);
+    return -1;
+}
+
+void batch_linearf(AnimationBatch* b, LinearAnimationF* la, float* times, int* rows, int count) {
+    int i, j;
+
+    /* each value on its own, as a point may lie partly in an output, or across two */
+    for (j=0; j<la->n; j++) {
+        int column = batch_column(b, la->v + j);
+        if (column < 0)
+            continue;
+
+        float start = la->start[j], delta = la->end[j] - la->start[j];
+        for (i=0; i<count; i++) {
+            int k = rows[i] * b->stride + column;
+            b->buffer[k]  = start + delta * times[i];
+            b->written[k] = TRUE;
+        }
+    }
+}
+
+void batch_node(AnimationBatch* b, Animation* a, float* times, int* rows, int count) {
+    int i;
+
+    switch (a->kind) {
+    case ANIMATION_NULL:
+        return;
+
+    case ANIMATION_LINEARF:
+        batch_linearf(b, (LinearAnimationF*)a, times, rows, count);
+        return;
+
+    case ANIMATION_PARALLEL: {
+        ParallelAnimation* pa = (ParallelAnimation*)a;
+        batch_child(b, pa->a1, times, rows, count);
+        batch_child(b, pa->a2, times, rows, count);
+        return;
+    }
+
+    default:
+        break;
+    }
+
+    float* local = malloc(sizeof(float) * count);
+    int* local_rows = malloc(sizeof(int) * count);
+
+    switch (a->kind) {
+    case ANIMATION_SCALED: {
+        ScaledAnimation* sa = (ScaledAnimation*)a;
+        for (i=0; i<count; i++)
+            local[i] = times[i] / sa->scale_factor;
+        batch_child(b, sa->child, local, rows, count);
+        break;
+    }
+
+    case ANIMATION_TRANSFORMED: {
+        TransformedAnimation* ta = (TransformedAnimation*)a;
+        float d = animation_duration(ta->child);
+        for (i=0; i<count; i++)
+            local[i] = apply_transform(ta->t, times[i] / d) * d;
+        batch_child(b, ta->child, local, rows, count);
+        break;
+    }
+
+    case ANIMATION_SEQUENCE: {
+        SequenceAnimation* sa = (SequenceAnimation*)a;
+        float d = animation_duration(sa->a1);
+        int n = 0;
+
+        for (i=0; i<count; i++)
+            if (times[i] <= d) {
+                local[n] = times[i];
+                local_rows[n++] = rows[i];
+            }
+        batch_child(b, sa->a1, local, local_rows, n);
+
+        for (i=0, n=0; i<count; i++)
+            if (times[i] > d) {
+                local[n] = times[i] - d;
+                local_rows[n++] = rows[i];
+            }
+        batch_child(b, sa->a2, local, local_rows, n);
+        break;
+    }
+
+    case ANIMATION_FLAT_SEQUENCE: {
+        FlatSequenceAnimation* fa = (FlatSequenceAnimation*)a;
+        int start = 0;
+
+        /* batch together each run of samples that fall in the same child */
+        while (start < count) {
+            int c = flat_sequence_animation_find(fa, times[start]), n = 0;
+            float d = animation_duration(fa->children[c]);
+
+            for (i=start; i<count && flat_sequence_animation_active(fa, c, times[i]); i++) {
+                float t = times[i] - fa->starts[c];
+                local[n] = t < d ? t : d;
+                local_rows[n++] = rows[i];
+            }
+
+            fa->cursor = c;
+            batch_child(b, fa->children[c], local, local_rows, n);
+            start = i;
+        }
+        break;
+    }
+
+    default:
+        g_assert_not_reached();
+    }
+
+    free(local);
+    free(local_rows);
+}
+
+void animation_sample_batch(Animation* a, const float* times, int count, float** outputs, const int* sizes, int noutputs, float* buffer, int stride) {
+    g_assert(a != NULL);
+    g_assert(times != NULL);
+    g_assert(outputs != NULL);
+    g_assert(sizes != NULL);
+    g_assert(buffer != NULL);
+    g_assert_cmpint(count, >=, 0);
+
+    int i, j, width = 0;
+    int* columns = malloc(sizeof(int) * noutputs);
+    for (j=0; j<noutputs; j++) {
+        columns[j] = width;
+        width += sizes[j];
+    }
+    g_assert_cmpint(stride, >=, width);
+
+    if (count == 0 || !animation_batchable(a)) {
+        for (i=0; i<count; i++) {
+            animation_update(a, times[i]);
+            for (j=0; j<noutputs; j++)
+                memcpy(buffer + i*stride + columns[j], outputs[j], sizeof(float) * sizes[j]);
+        }
+
+        free(columns);
+        return;
+    }
+
+    AnimationBatch b;
+    b.outputs  = outputs;
+    b.sizes    = sizes;
+    b.columns  = columns;
+    b.noutputs = noutputs;
+    b.buffer   = buffer;
+    b.stride   = stride;
+    b.written  = calloc(count * stride, sizeof(char));
+
+    float* local = malloc(sizeof(float) * count);
+    int* rows = malloc(sizeof(int) * count);
+    for (i=0; i<count; i++) {
+        assert_rangef(times[i], 0.0, animation_duration(a));
+        local[i] = times[i];
+        rows[i]  = i;
+    }
+
+    batch_node(&b, a, local, rows, count);
+
+    /* an output that no node wrote at some time keeps the value it had at the previous time, as with animation_update */
+    for (i=0; i<count; i++)
+        for (j=0; j<noutputs; j++) {
+            int k, c;
+            for (k=0, c=columns[j]; k<sizes[j]; k++, c++)
+                if (!b.written[i*stride + c])
+                    buffer[i*stride + c] = (i == 0) ? outputs[j][k] : buffer[(i-1)*stride + c];
+        }
+
+    /* leave every animated value as a final animation_update would have */
+    animation_update(a, times[count-1]);
+    for (j=0; j<noutputs; j++)
+        memcpy(outputs[j], buffer + (count-1)*stride + columns[j], sizeof(float) * sizes[j]);
+
+    free(local);
+    free(rows);
+    free(b.written);
+    free(columns);
+}
+
+/* baked animation - outputs sampled at a fixed rate, played back by linear interpolation between samples */
+
+typedef struct BakedAnimationStruct {
     Animation a;
-    Animation* a1;
-    Animation* a2;
-} SequenceAnimation;
+    float duration;
+    float rate;
+    int k;            /* samples, the ith at time min(i/rate, duration) */
+    int noutputs;
+    float** outputs;
+    int* sizes;
+    int width;        /* floats per sample */
+    float* samples;
+} BakedAnimation;
+
+float baked_animation_time(BakedAnimation* ba, int i) {
+    return (i == ba->k-1) ? ba->duration : i / ba->rate;
+}
 
-void sequence_animation_update(Animation* a, float f) {
-    SequenceAnimation* as = (SequenceAnimation*)a;
+void baked_animation_update(Animation* a, float f) {
+    BakedAnimation* ba = (BakedAnimation*)a;
 
-    float d = animation_duration(as->a1);
+    int i = 0, j, l;
+    float x = 0.0;
 
-    if (f <= d)
-        animation_update(as->a1, f);
-    else
-        animation_update(as->a2, f-d);
+    if (ba->k > 1) {
+        i = (int)(f * ba->rate);
+        if (i > ba->k - 2)
+            i = ba->k - 2;
+
+        float t0 = baked_animation_time(ba, i), t1 = baked_animation_time(ba, i+1);
+        x = (f - t0) / (t1 - t0);
+    }
+
+    float *s0 = ba->samples + i * ba->width, *s1 = (ba->k > 1) ? s0 + ba->width : s0;
+    for (j=0; j<ba->noutputs; j++) {
+        float* v = ba->outputs[j];
+        for (l=0; l<ba->sizes[j]; l++, s0++, s1++)
+            v[l] = *s0 + (*s1 - *s0) * x;
+    }
 }
 
-void sequence_animation_free(Animation* a) {
-    SequenceAnimation* as = (SequenceAnimation*)a;
-    animation_free(as->a1);
-    animation_free(as->a2);
+void baked_animation_free(Animation* a) {
+    BakedAnimation* ba = (BakedAnimation*)a;
+    free(ba->outputs);
+    free(ba->sizes);
+    free(ba->samples);
     default_animation_free(a);
 }
 
-float sequence_animation_duration(Animation* a) {
-    SequenceAnimation* as = (SequenceAnimation*)a;
-    return animation_duration(as->a1) + animation_duration(as->a2);
+float baked_animation_duration(Animation* a) {
+    BakedAnimation* ba = (BakedAnimation*)a;
+    return ba->duration;
 }
 
-Animation* sequence(Animation* a1, Animation* a2) {
-    g_assert(a1 != NULL);
-    g_assert(a2 != NULL);
+Animation* animation_bake(Animation* a, float sample_rate, float** outputs, const int* sizes, int noutputs) {
+    g_assert(a != NULL);
+    g_assert(outputs != NULL);
+    g_assert(sizes != NULL);
+    g_assert_cmpfloat(sample_rate, >, 0.0);
+    g_assert_cmpint(noutputs, >, 0);
+
+    int i, j;
+
+    BakedAnimation* ba = animation_alloc(sizeof(BakedAnimation));
+    ba->duration = animation_duration(a);
+    ba->rate     = sample_rate;
+    ba->k        = (int)ceil(ba->duration * sample_rate) + 1;
+    ba->noutputs = noutputs;
+    ba->outputs  = animation_alloc(sizeof(float*) * noutputs);
+    ba->sizes    = animation_alloc(sizeof(int) * noutputs);
+    ba->width    = 0;
+    for (j=0; j<noutputs; j++) {
+        ba->outputs[j] = outputs[j];
+        ba->sizes[j]   = sizes[j];
+        ba->width     += sizes[j];
+    }
 
-    SequenceAnimation* a = malloc(sizeof(SequenceAnimation));
-    a->a.update   = sequence_animation_update;
-    a->a.duration = sequence_animation_duration;
-    a->a.free     = sequence_animation_free;
-    a->a1 = a1;
-    a->a2 = a2;
-    return (Animation*)a;
+    /* ceil may land one sample past the end */
+    if (ba->k > 1 && (ba->k - 2) / sample_rate >= ba->duration)
+        ba->k--;
+
+    float* times = malloc(sizeof(float) * ba->k);
+    for (i=0; i<ba->k; i++)
+        times[i] = baked_animation_time(ba, i);
+
+    ba->samples = animation_alloc(sizeof(float) * ba->k * ba->width);
+    animation_sample_batch(a, times, ba->k, outputs, sizes, noutputs, ba->samples, ba->width);
+    free(times);
+
+    animation_init(&ba->a, ANIMATION_BAKED, baked_animation_update, baked_animation_duration, baked_animation_free, default_animation_visit);
+    return (Animation*)ba;
+}
+
+float animation_bake_error(Animation* baked, Animation* source) {
+    g_assert(baked != NULL);
+    g_assert(source != NULL);
+    g_assert_cmpint(baked->kind, ==, ANIMATION_BAKED);
+
+    BakedAnimation* ba = (BakedAnimation*)baked;
+    float* expected = malloc(sizeof(float) * ba->width);
+    float error = 0.0;
+    int i, j, l;
+
+    /* linear interpolation is worst midway between samples.  source is also updated at each sample, in order, so that
+     * outputs it leaves untouched hold the same values they held while baking */
+    for (i=0; i+1<ba->k; i++) {
+        float t = (baked_animation_time(ba, i) + baked_animation_time(ba, i+1)) / 2.0;
+        float* e = expected;
+
+        animation_update(source, baked_animation_time(ba, i));
+        animation_update(source, t);
+        for (j=0; j<ba->noutputs; j++, e += ba->sizes[j-1])
+            memcpy(e, ba->outputs[j], sizeof(float) * ba->sizes[j]);
+
+        animation_update(baked, t);
+        for (j=0, e=expected; j<ba->noutputs; j++)
+            for (l=0; l<ba->sizes[j]; l++, e++)
+                if (fabs(ba->outputs[j][l] - *e) > error)
+                    error = fabs(ba->outputs[j][l] - *e);
+    }
+
+    free(expected);
+    return error;
+}
+
+/* animation instances - one template animation played by many instances, each with its own targets, offset and rate.
+ *
+ * An update gathers the distinct times the live instances sample, samples the template at all of them with
+ * animation_sample_batch, and copies each row of samples to the instances that sample that time.
+ */
+
+typedef struct InstanceTimeStruct {
+    float t;
+    int instance;
+} InstanceTime;
+
+struct AnimationInstancesStruct {
+    Animation* animation;
+    float duration;
+    int noutputs;
+    float** outputs;
+    int* sizes;
+    int width;          /* floats per sample */
+
+    GArray* targets;    /* noutputs per instance */
+    GArray* offsets;
+    GArray* rates;
+    GArray* live;       /* gboolean per instance */
+    GArray* unused;     /* removed instances, whose slots are reused */
+
+    InstanceTime* times;
+    float* distinct;
+    float* samples;
+    int capacity;       /* of times, distinct and samples, in instances */
+};
+
+AnimationInstances* animation_instances_new(Animation* a, float** outputs, const int* sizes, int noutputs) {
+    g_assert(a != NULL);
+    g_assert(outputs != NULL);
+    g_assert(sizes != NULL);
+    g_assert_cmpint(noutputs, >, 0);
+
+    int j;
+    AnimationInstances* is = malloc(sizeof(AnimationInstances));
+    is->animation = a;
+    is->duration  = animation_duration(a);
+    is->noutputs  = noutputs;
+    is->outputs   = malloc(sizeof(float*) * noutputs);
+    is->sizes     = malloc(sizeof(int) * noutputs);
+    is->width     = 0;
+    for (j=0; j<noutputs; j++) {
+        g_assert(outputs[j] != NULL);
+        g_assert_cmpint(sizes[j], >, 0);
+        is->outputs[j] = outputs[j];
+        is->sizes[j]   = sizes[j];
+        is->width     += sizes[j];
+    }
+
+    is->targets  = g_array_new(FALSE, FALSE, sizeof(float*));
+    is->offsets  = g_array_new(FALSE, FALSE, sizeof(float));
+    is->rates    = g_array_new(FALSE, FALSE, sizeof(float));
+    is->live     = g_array_new(FALSE, FALSE, sizeof(gboolean));
+    is->unused   = g_array_new(FALSE, FALSE, sizeof(int));
+    is->times    = NULL;
+    is->distinct = NULL;
+    is->samples  = NULL;
+    is->capacity = 0;
+    return is;
+}
+
+int animation_instances_add(AnimationInstances* is, float** targets, float offset, float rate) {
+    g_assert(is != NULL);
+    g_assert(targets != NULL);
+    g_assert_cmpfloat(rate, >, 0.0);
+
+    int i, j;
+
+    if (is->unused->len > 0) {
+        i = g_array_index(is->unused, int, is->unused->len - 1);
+        g_array_set_size(is->unused, is->unused->len - 1);
+    } else {
+        i = is->live->len;
+        g_array_set_size(is->targets, (i+1) * is->noutputs);
+        g_array_set_size(is->offsets, i+1);
+        g_array_set_size(is->rates, i+1);
+        g_array_set_size(is->live, i+1);
+    }
+
+    for (j=0; j<is->noutputs; j++) {
+        g_assert(targets[j] != NULL);
+        g_array_index(is->targets, float*, i * is->noutputs + j) = targets[j];
+    }
+    g_array_index(is->offsets, float, i) = offset;
+    g_array_index(is->rates, float, i)   = rate;
+    g_array_index(is->live, gboolean, i) = TRUE;
+    return i;
+}
+
+void animation_instances_remove(AnimationInstances* is, int i) {
+    g_assert(is != NULL);
+    g_assert_cmpint(i, >=, 0);
+    g_assert_cmpint(i, <, is->live->len);
+    g_assert(g_array_index(is->live, gboolean, i));
+
+    g_array_index(is->live, gboolean, i) = FALSE;
+    g_array_append_val(is->unused, i);
+}
+
+int instance_time_compare(const void* p, const void* q) {
+    const InstanceTime *a = p, *b = q;
+    if (a->t != b->t)
+        return (a->t < b->t) ? -1 : 1;
+    return a->instance - b->instance;
+}
+
+gboolean animation_instances_update(AnimationInstances* is, float time) {
+    g_assert(is != NULL);
+
+    int i, j, k, n = 0, ndistinct = 0, ninstances = is->live->len;
+    gboolean more = FALSE;
+
+    if (is->capacity < ninstances) {
+        is->capacity = ninstances;
+        is->times    = realloc(is->times, sizeof(InstanceTime) * ninstances);
+        is->distinct = realloc(is->distinct, sizeof(float) * ninstances);
+        is->samples  = realloc(is->samples, sizeof(float) * ninstances * is->width);
+    }
+
+    for (i=0; i<ninstances; i++) {
+        if (!g_array_index(is->live, gboolean, i))
+            continue;
+
+        float t = (time - g_array_index(is->offsets, float, i)) * g_array_index(is->rates, float, i);
+        if (t < 0.0)
+            t = 0.0;
+        if (t < is->duration)
+            more = TRUE;
+        else
+            t = is->duration;
+
+        is->times[n].t        = t;
+        is->times[n].instance = i;
+        n++;
+    }
+
+    if (n == 0)
+        return FALSE;
+
+    /* in increasing time, so that the template plays forward */
+    qsort(is->times, n, sizeof(InstanceTime), instance_time_compare);
+    for (i=0; i<n; i++)
+        if (ndistinct == 0 || is->times[i].t != is->distinct[ndistinct-1])
+            is->distinct[ndistinct++] = is->times[i].t;
+
+    animation_sample_batch(is->animation, is->distinct, ndistinct, is->outputs, is->sizes, is->noutputs, is->samples, is->width);
+
+    for (i=0, k=-1; i<n; i++) {
+        if (k < 0 || is->times[i].t != is->distinct[k])
+            k++;
+
+        float* row = is->samples + k * is->width;
+        float** targets = &g_array_index(is->targets, float*, is->times[i].instance * is->noutputs);
+        for (j=0; j<is->noutputs; j++) {
+            memcpy(targets[j], row, sizeof(float) * is->sizes[j]);
+            row += is->sizes[j];
+        }
+    }
+
+    return more;
+}
+
+void animation_instances_free(AnimationInstances* is) {
+    g_assert(is != NULL);
+
+    animation_free(is->animation);
+    free(is->outputs);
+    free(is->sizes);
+    g_array_free(is->targets, TRUE);
+    g_array_free(is->offsets, TRUE);
+    g_array_free(is->rates, TRUE);
+    g_array_free(is->live, TRUE);
+    g_array_free(is->unused, TRUE);
+    free(is->times);
+    free(is->distinct);
+    free(is->samples);
+    free(is);
+}
+
+/* tween pools - many single-value tweens held as parallel arrays and updated in one sweep.
+ *
+ * The sweep computes every slot's eased value with a vector kernel, dead slots included, and then writes the values of
+ * the tweens that have started to their targets.  The kernels perform exactly the operations of the scalar one, and
+ * the sinusoid easing those of sinusoid_transform, so all produce identical results.
+ */
+
+#define TWEEN_POOL_INITIAL_CAPACITY 64
+
+typedef void (*TweenKernel)(const float* start, const float* delta, const float* start_time, const float* rate, const int* easing, float* out, int n, float time);
+
+struct AnimationTweenPoolStruct {
+    int n;              /* slots in use or on the free list */
+    int capacity;
+    int live;
+    float* start;
+    float* delta;       /* end - start */
+    float* start_time;
+    float* rate;        /* 1 / duration */
+    int* easing;
+    float** target;     /* NULL for a free slot */
+    float* values;
+    int* unused;        /* free slots */
+    int nunused;
+    TweenKernel kernel;
+};
+
+void tween_kernel_scalar(const float* start, const float* delta, const float* start_time, const float* rate, const int* easing, float* out, int n, float time) {
+    int i;
+    for (i=0; i<n; i++) {
+        float u = (time - start_time[i]) * rate[i], e;
+        u = (u > 0.0f) ? u : 0.0f;
+        u = (u < 1.0f) ? u : 1.0f;
+
+        switch (easing[i]) {
+        case TWEEN_SINUSOID:
+            e = sinusoid_transform_function(NULL, u);
+            break;
+        case TWEEN_QUADRATIC:
+            e = u * u;
+            break;
+        case TWEEN_CUBIC:
+            e = u * u * u;
+            break;
+        default:
+            e = u;
+            break;
+        }
+
+        out[i] = start[i] + delta[i] * e;
+    }
+}
+
+#ifdef ANIM_X86_SIMD
+
+__attribute__((target("sse2")))
+void tween_kernel_sse2(const float* start, const float* delta, const float* start_time, const float* rate, const int* easing, float* out, int n, float time) {
+    int i;
+    __m128 t = _mm_set1_ps(time), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+    for (i=0; i+4<=n; i+=4) {
+        __m128 u = _mm_mul_ps(_mm_sub_ps(t, _mm_loadu_ps(start_time+i)), _mm_loadu_ps(rate+i));
+        u = _mm_min_ps(_mm_max_ps(u, zero), one);
+
+        __m128 x = _mm_mul_ps(_mm_sub_ps(u, half), _mm_set1_ps(SINUSOID_PI)), z = _mm_mul_ps(x, x);
+        __m128 p = _mm_add_ps(_mm_set1_ps(SINUSOID_4), _mm_mul_ps(z, _mm_set1_ps(SINUSOID_5)));
+        p = _mm_add_ps(_mm_set1_ps(SINUSOID_3), _mm_mul_ps(z, p));
+        p = _mm_add_ps(_mm_set1_ps(SINUSOID_2), _mm_mul_ps(z, p));
+        p = _mm_add_ps(_mm_set1_ps(SINUSOID_1), _mm_mul_ps(z, p));
+        p = _mm_mul_ps(x, _mm_add_ps(one, _mm_mul_ps(z, p)));
+        __m128 sinusoid = _mm_min_ps(_mm_max_ps(_mm_add_ps(half, _mm_mul_ps(half, p)), zero), one);
+        __m128 at_end = _mm_cmpge_ps(u, one);
+        sinusoid = _mm_or_ps(_mm_and_ps(at_end, one), _mm_andnot_ps(_mm_or_ps(at_end, _mm_cmple_ps(u, zero)), sinusoid));
+
+        __m128 square = _mm_mul_ps(u, u), cube = _mm_mul_ps(square, u);
+        __m128i k = _mm_loadu_si128((__m128i*)(easing+i));
+        __m128 is_sinusoid  = _mm_castsi128_ps(_mm_cmpeq_epi32(k, _mm_set1_epi32(TWEEN_SINUSOID)));
+        __m128 is_quadratic = _mm_castsi128_ps(_mm_cmpeq_epi32(k, _mm_set1_epi32(TWEEN_QUADRATIC)));
+        __m128 is_cubic     = _mm_castsi128_ps(_mm_cmpeq_epi32(k, _mm_set1_epi32(TWEEN_CUBIC)));
+        __m128 e = _mm_andnot_ps(_mm_or_ps(is_sinusoid, _mm_or_ps(is_quadratic, is_cubic)), u);
+        e = _mm_or_ps(e, _mm_and_ps(is_sinusoid, sinusoid));
+        e = _mm_or_ps(e, _mm_and_ps(is_quadratic, square));
+        e = _mm_or_ps(e, _mm_and_ps(is_cubic, cube));
+
+        _mm_storeu_ps(out+i, _mm_add_ps(_mm_loadu_ps(start+i), _mm_mul_ps(_mm_loadu_ps(delta+i), e)));
+    }
+    tween_kernel_scalar(start+i, delta+i, start_time+i, rate+i, easing+i, out+i, n-i, time);
+}
+
+__attribute__((target("avx2")))
+void tween_kernel_avx2(const float* start, const float* delta, const float* start_time, const float* rate, const int* easing, float* out, int n, float time) {
+    int i;
+    __m256 t = _mm256_set1_ps(time), zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+    for (i=0; i+8<=n; i+=8) {
+        __m256 u = _mm256_mul_ps(_mm256_sub_ps(t, _mm256_loadu_ps(start_time+i)), _mm256_loadu_ps(rate+i));
+        u = _mm256_min_ps(_mm256_max_ps(u, zero), one);
+
+        __m256 x = _mm256_mul_ps(_mm256_sub_ps(u, half), _mm256_set1_ps(SINUSOID_PI)), z = _mm256_mul_ps(x, x);
+        __m256 p = _mm256_add_ps(_mm256_set1_ps(SINUSOID_4), _mm256_mul_ps(z, _mm256_set1_ps(SINUSOID_5)));
+        p = _mm256_add_ps(_mm256_set1_ps(SINUSOID_3), _mm256_mul_ps(z, p));
+        p = _mm256_add_ps(_mm256_set1_ps(SINUSOID_2), _mm256_mul_ps(z, p));
+        p = _mm256_add_ps(_mm256_set1_ps(SINUSOID_1), _mm256_mul_ps(z, p));
+        p = _mm256_mul_ps(x, _mm256_add_ps(one, _mm256_mul_ps(z, p)));
+        __m256 sinusoid = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(half, _mm256_mul_ps(half, p)), zero), one);
+        sinusoid = _mm256_blendv_ps(sinusoid, zero, _mm256_cmp_ps(u, zero, _CMP_LE_OQ));
+        sinusoid = _mm256_blendv_ps(sinusoid, one, _mm256_cmp_ps(u, one, _CMP_GE_OQ));
+
+        __m256 square = _mm256_mul_ps(u, u), cube = _mm256_mul_ps(square, u);
+        __m256i k = _mm256_loadu_si256((__m256i*)(easing+i));
+        __m256 e = u;
+        e = _mm256_blendv_ps(e, sinusoid, _mm256_castsi256_ps(_mm256_cmpeq_epi32(k, _mm256_set1_epi32(TWEEN_SINUSOID))));
+        e = _mm256_blendv_ps(e, square, _mm256_castsi256_ps(_mm256_cmpeq_epi32(k, _mm256_set1_epi32(TWEEN_QUADRATIC))));
+        e = _mm256_blendv_ps(e, cube, _mm256_castsi256_ps(_mm256_cmpeq_epi32(k, _mm256_set1_epi32(TWEEN_CUBIC))));
+
+        _mm256_storeu_ps(out+i, _mm256_add_ps(_mm256_loadu_ps(start+i), _mm256_mul_ps(_mm256_loadu_ps(delta+i), e)));
+    }
+    tween_kernel_scalar(start+i, delta+i, start_time+i, rate+i, easing+i, out+i, n-i, time);
+}
+
+#endif
+
+/* the best kernel this cpu supports */
+TweenKernel tween_kernel() {
+    static const TweenKernel k[CPU_LEVELS] = {
+        tween_kernel_scalar,
+#ifdef ANIM_X86_SIMD
+        tween_kernel_sse2,
+        tween_kernel_avx2
+#endif
+    };
+
+    return k[cpu_level()];
+}
+
+AnimationTweenPool* animation_tween_pool_new() {
+    AnimationTweenPool* p = malloc(sizeof(AnimationTweenPool));
+    p->n          = 0;
+    p->capacity   = 0;
+    p->live       = 0;
+    p->start      = NULL;
+    p->delta      = NULL;
+    p->start_time = NULL;
+    p->rate       = NULL;
+    p->easing     = NULL;
+    p->target     = NULL;
+    p->values     = NULL;
+    p->unused     = NULL;
+    p->nunused    = 0;
+    p->kernel     = tween_kernel();
+    return p;
+}
+
+void tween_pool_grow(AnimationTweenPool* p) {
+    p->capacity   = (p->capacity > 0) ? p->capacity * 2 : TWEEN_POOL_INITIAL_CAPACITY;
+    p->start      = realloc(p->start, sizeof(float) * p->capacity);
+    p->delta      = realloc(p->delta, sizeof(float) * p->capacity);
+    p->start_time = realloc(p->start_time, sizeof(float) * p->capacity);
+    p->rate       = realloc(p->rate, sizeof(float) * p->capacity);
+    p->easing     = realloc(p->easing, sizeof(int) * p->capacity);
+    p->target     = realloc(p->target, sizeof(float*) * p->capacity);
+    p->values     = realloc(p->values, sizeof(float) * p->capacity);
+    p->unused     = realloc(p->unused, sizeof(int) * p->capacity);
+}
+
+int animation_tween_pool_add(AnimationTweenPool* p, float* target, float start, float end, float duration, float start_time, AnimationEasing easing) {
+    g_assert(p != NULL);
+    g_assert(target != NULL);
+    g_assert_cmpfloat(duration, >, 0.0);
+    g_assert_cmpint(easing, >=, TWEEN_LINEAR);
+    g_assert_cmpint(easing, <=, TWEEN_CUBIC);
+
+    int i;
+    if (p->nunused > 0) {
+        i = p->unused[--p->nunused];
+    } else {
+        if (p->n == p->capacity)
+            tween_pool_grow(p);
+        i = p->n++;
+    }
+
+    p->start[i]      = start;
+    p->delta[i]      = end - start;
+    p->start_time[i] = start_time;
+    p->rate[i]       = 1.0 / duration;
+    p->easing[i]     = easing;
+    p->target[i]     = target;
+    p->live++;
+    return i;
+}
+
+void tween_pool_release(AnimationTweenPool* p, int i) {
+    p->target[i] = NULL;
+    p->unused[p->nunused++] = i;
+    p->live--;
+}
+
+void animation_tween_pool_remove(AnimationTweenPool* p, int tween) {
+    g_assert(p != NULL);
+    g_assert_cmpint(tween, >=, 0);
+    g_assert_cmpint(tween, <, p->n);
+    g_assert(p->target[tween] != NULL);
+
+    tween_pool_release(p, tween);
+}
+
+gboolean animation_tween_pool_update(AnimationTweenPool* p, float time) {
+    g_assert(p != NULL);
+
+    int i;
+    p->kernel(p->start, p->delta, p->start_time, p->rate, p->easing, p->values, p->n, time);
+
+    for (i=0; i<p->n; i++) {
+        if (p->target[i] == NULL || time < p->start_time[i])
+            continue;
+
+        *p->target[i] = p->values[i];
+
+        /* the tween has written its end value */
+        if ((time - p->start_time[i]) * p->rate[i] >= 1.0f)
+            tween_pool_release(p, i);
+    }
+
+    return p->live > 0;
+}
+
+int animation_tween_pool_size(AnimationTweenPool* p) {
+    g_assert(p != NULL);
+    return p->live;
+}
+
+void animation_tween_pool_free(AnimationTweenPool* p) {
+    g_assert(p != NULL);
+
+    free(p->start);
+    free(p->delta);
+    free(p->start_time);
+    free(p->rate);
+    free(p->easing);
+    free(p->target);
+    free(p->values);
+    free(p->unused);
+    free(p);
+}
+
+
+/* animation images - a tree saved as a table of fixed-size nodes, followed by their data and the names of the outputs
+ * they write, which is played straight from the mapped file.
+ *
+ * Nodes refer to their children by index, to their data by offset from the start of the image, and to the values they
+ * write by slot and byte offset within the slot.  A slot is an output named when the tree is saved, and bound to
+ * memory by that name when it is loaded, so the same image can drive different objects.  Loading binds the slots
+ * and makes one pass over the nodes, checking that every offset, index and kind they hold stays within the image and
+ * its slots, and that children come before their parents, as animation_save writes them.  The nodes are neither parsed
+ * nor copied, and the only allocation is one block for the bindings and the sequences' cursors.  Images are written
+ * in the byte order of the machine that saved them.
+ *
+ * The data of each kind of node:
+ *   linearf, lineari    the n start values, then the n end values
+ *   bezierf             m rows of n coefficients, as doubles
+ *   transformed         the curve of a cubic bezier, or a lut's size followed at the next 8 bytes by its table
+ *   sequence            the n+1 start times of the children
+ *   derived             m derived values
+ * Chained transforms are saved as one transformed node per part, and compiled animations as their source.
+ */
+
+#define IMAGE_MAGIC "ANIM"
+#define IMAGE_VERSION 2
+
+typedef enum {
+    IMAGE_NODE_NULL,
+    IMAGE_NODE_LINEARF,
+    IMAGE_NODE_LINEARI,
+    IMAGE_NODE_BEZIERF,
+    IMAGE_NODE_SCALED,
+    IMAGE_NODE_TRANSFORMED,
+    IMAGE_NODE_SEQUENCE,     /* binary and flat sequences alike */
+    IMAGE_NODE_PARALLEL,
+    IMAGE_NODE_DERIVED,
+    IMAGE_NODE_KINDS
+} ImageNodeKind;
+
+typedef enum {
+    IMAGE_TRANSFORM_IDENTITY,
+    IMAGE_TRANSFORM_SINUSOID,
+    IMAGE_TRANSFORM_REVERSE,
+    IMAGE_TRANSFORM_EXPONENT,
+    IMAGE_TRANSFORM_EXPONENT_INTEGER,
+    IMAGE_TRANSFORM_LUT,
+    IMAGE_TRANSFORM_CUBIC_BEZIER,
+    IMAGE_TRANSFORM_KINDS
+} ImageTransformKind;
+
+typedef enum {
+    IMAGE_DERIVE_CLAMP,
+    IMAGE_DERIVE_AFFINE,
+    IMAGE_DERIVE_SIN,
+    IMAGE_DERIVE_COS,
+    IMAGE_DERIVE_ROUND,
+    IMAGE_DERIVE_FTOI,
+    IMAGE_DERIVE_ITOF,
+    IMAGE_DERIVE_KINDS
+} ImageDeriveKind;
+
+typedef struct ImageHeaderStruct {
+    char magic[4];
+    guint32 version;
+    guint32 size;             /* of the whole image */
+    guint32 root;
+    guint32 nslots, slots;    /* how many, and the offset of the first */
+    guint32 nnodes, nodes;
+} ImageHeader;
+
+typedef struct ImageSlotStruct {
+    guint32 name;             /* offset of the nul-terminated name */
+    guint32 bytes;
+} ImageSlot;
+
+typedef struct ImageNodeStruct {
+    guint32 kind;             /* an ImageNodeKind */
+    guint32 n;                /* values written, or children */
+    guint32 m;                /* control points, derived values, or an ImageTransformKind */
+    guint32 slot, offset;     /* where a leaf writes */
+    guint32 children;         /* offset of the children's indices */
+    guint32 data;             /* offset of the node's own data */
+    float param;              /* scale factor or exponent */
+    float duration;
+} ImageNode;
+
+typedef struct ImageDerivedValueStruct {
+    guint32 kind;             /* an ImageDeriveKind */
+    guint32 n;
+    guint32 in_slot, in_offset;
+    guint32 out_slot, out_offset;
+    float a, b;
+} ImageDerivedValue;
+
+/* saving */
+
+typedef struct ImageWriterStruct {
+    GArray* nodes;            /* children before their parents */
+    GArray* data;             /* offsets into it are relative until the image is put together */
+    const char** names;
+    void** outputs;
+    const int* sizes;
+    int nslots;
+    gboolean ok;              /* every node so far could be saved */
+} ImageWriter;
+
+/* append bytes bytes to a at the next multiple of 8, zeroed if p is NULL, and return their offset */
+guint32 image_append(GArray* a, const void* p, size_t bytes) {
+    guint32 offset = (a->len + 7) & ~7;
+    g_array_set_size(a, offset + bytes);
+    if (p != NULL && bytes > 0)
+        memcpy(a->data + offset, p, bytes);
+    return offset;
+}
+
+/* the slot and offset of bytes bytes at p, which must lie within one output */
+void image_bind(ImageWriter* w, const void* p, int bytes, guint32* slot, guint32* offset) {
+    int j;
+    for (j=0; j<w->nslots; j++) {
+        const char* output = w->outputs[j];
+        if ((const char*)p >= output && (const char*)p + bytes <= output + w->sizes[j]) {
+            *slot   = j;
+            *offset = (const char*)p - output;
+            return;
+        }
+    }
+
+    w->ok = FALSE;
+}
+
+ImageNode image_node(ImageNodeKind kind, float duration) {
+    ImageNode node;
+    memset(&node, 0, sizeof(ImageNode));
+    node.kind     = kind;
+    node.duration = duration;
+    return node;
+}
+
+guint32 image_add(ImageWriter* w, ImageNode* node) {
+    g_array_append_val(w->nodes, *node);
+    return w->nodes->len - 1;
+}
+
+guint32 save_node(ImageWriter* w, Animation* a);
+
+/* save n children, and return the offset of their indices */
+guint32 save_children(ImageWriter* w, Animation** children, int n) {
+    guint32* indices = malloc(sizeof(guint32) * n);
+    int j;
+    for (j=0; j<n; j++)
+        indices[j] = save_node(w, children[j]);
+
+    guint32 offset = image_append(w->data, indices, sizeof(guint32) * n);
+    free(indices);
+    return offset;
+}
+
+void save_transform_part(ImageWriter* w, ImageNode* node, TimeTransform* t) {
+    if (t->f == identity_transform_function) {
+        node->m = IMAGE_TRANSFORM_IDENTITY;
+    } else if (t->f == sinusoid_transform_function) {
+        node->m = IMAGE_TRANSFORM_SINUSOID;
+    } else if (t->f == reverse_transform_function) {
+        node->m = IMAGE_TRANSFORM_REVERSE;
+    } else if (is_exponent_transform(t)) {
+        node->m     = (t->f == exponent_transform_function) ? IMAGE_TRANSFORM_EXPONENT : IMAGE_TRANSFORM_EXPONENT_INTEGER;
+        node->param = ((exponentTransform*)t)->exponent;
+    } else if (t->f == lut_transform_function) {
+        LutTransform* l = (LutTransform*)t;
+        guint32 size = l->size;
+        node->m    = IMAGE_TRANSFORM_LUT;
+        node->data = image_append(w->data, &size, sizeof(guint32));
+        image_append(w->data, l->table, sizeof(float) * (l->size+1));
+    } else if (t->f == cubic_bezier_transform_function) {
+        node->m    = IMAGE_TRANSFORM_CUBIC_BEZIER;
+        node->data = image_append(w->data, &((CubicBezierTransform*)t)->c, sizeof(CubicBezierCurve));
+    } else {
+        w->ok = FALSE;
+    }
+}
+
+/* save child under t, one node for each part of a chained transform */
+guint32 save_transformed(ImageWriter* w, Animation* child, TimeTransform* t) {
+    gboolean chain = (t->f == chain_transform_function);
+    TimeTransform** parts = chain ? ((ChainTransform*)t)->parts : &t;
+    int j, n = chain ? ((ChainTransform*)t)->n : 1;
+
+    guint32 i = save_node(w, child);
+    for (j=n-1; j>=0; j--) {
+        ImageNode node = image_node(IMAGE_NODE_TRANSFORMED, child->cached_duration);
+        node.n        = 1;
+        node.children = image_append(w->data, &i, sizeof(guint32));
+        save_transform_part(w, &node, parts[j]);
+        i = image_add(w, &node);
+    }
+
+    return i;
+}
+
+void save_derived_value(ImageWriter* w, DerivedValue* dv, ImageDerivedValue* r) {
+    ConcreteDerivedValue* cdv = (ConcreteDerivedValue*)dv;
+
+    if (dv->update == concrete_derived_value_update_clamp)
+        r->kind = IMAGE_DERIVE_CLAMP;
+    else if (dv->update == concrete_derived_value_update_affine)
+        r->kind = IMAGE_DERIVE_AFFINE;
+    else if (dv->update == concrete_derived_value_update_ffv && cdv->transform == (void*)transformv_sin)
+        r->kind = IMAGE_DERIVE_SIN;
+    else if (dv->update == concrete_derived_value_update_ffv && cdv->transform == (void*)transformv_cos)
+        r->kind = IMAGE_DERIVE_COS;
+    else if (dv->update == concrete_derived_value_update_ffv && cdv->transform == (void*)transformv_round)
+        r->kind = IMAGE_DERIVE_ROUND;
+    else if (dv->update == concrete_derived_value_update_fiv && cdv->transform == (void*)transformv_ftoi)
+        r->kind = IMAGE_DERIVE_FTOI;
+    else if (dv->update == concrete_derived_value_update_ifv && cdv->transform == (void*)transformv_itof)
+        r->kind = IMAGE_DERIVE_ITOF;
+    else {
+        w->ok = FALSE;
+        return;
+    }
+
+    r->n = cdv->n;
+    r->a = cdv->a;
+    r->b = cdv->b;
+    image_bind(w, dv->in, dv->in_bytes, &r->in_slot, &r->in_offset);
+    image_bind(w, dv->out, dv->out_bytes, &r->out_slot, &r->out_offset);
+}
+
+/* save a and its descendants, and return a's index */
+guint32 save_node(ImageWriter* w, Animation* a) {
+    ImageNode node = image_node(IMAGE_NODE_NULL, a->cached_duration);
+    Animation* children[2];
+    int j;
+
+    switch (a->kind) {
+    case ANIMATION_NULL:
+        break;
+
+    case ANIMATION_LINEARF:
+    case ANIMATION_LINEARI: {
+        /* floats and ints have the same size, and the layouts of the two nodes match */
+        LinearAnimationF* la = (LinearAnimationF*)a;
+        size_t bytes = sizeof(float) * la->n;
+        node.kind = (a->kind == ANIMATION_LINEARF) ? IMAGE_NODE_LINEARF : IMAGE_NODE_LINEARI;
+        node.n    = la->n;
+        node.data = image_append(w->data, NULL, 2 * bytes);
+        memcpy(w->data->data + node.data, la->start, bytes);
+        memcpy(w->data->data + node.data + bytes, la->end, bytes);
+        image_bind(w, la->v, bytes, &node.slot, &node.offset);
+        break;
+    }
+
+    case ANIMATION_BEZIERF: {
+        BezierAnimationF* ba = (BezierAnimationF*)a;
+        node.kind = IMAGE_NODE_BEZIERF;
+        node.n    = ba->n;
+        node.m    = ba->m;
+        node.data = image_append(w->data, ba->coefficients, sizeof(double) * ba->m * ba->n);
+        image_bind(w, ba->v, sizeof(float) * ba->n, &node.slot, &node.offset);
+        break;
+    }
+
+    case ANIMATION_SCALED: {
+        ScaledAnimation* sa = (ScaledAnimation*)a;
+        node.kind     = IMAGE_NODE_SCALED;
+        node.n        = 1;
+        node.param    = sa->scale_factor;
+        node.children = save_children(w, &sa->child, 1);
+        break;
+    }
+
+    case ANIMATION_TRANSFORMED: {
+        TransformedAnimation* ta = (TransformedAnimation*)a;
+        return save_transformed(w, ta->child, ta->t);
+    }
+
+    case ANIMATION_SEQUENCE: {
+        SequenceAnimation* sa = (SequenceAnimation*)a;
+        float starts[3];
+        children[0] = sa->a1;
+        children[1] = sa->a2;
+        starts[0]   = 0.0;
+        starts[1]   = sa->a1->cached_duration;
+        starts[2]   = starts[1] + sa->a2->cached_duration;
+        node.kind     = IMAGE_NODE_SEQUENCE;
+        node.n        = 2;
+        node.children = save_children(w, children, 2);
+        node.data     = image_append(w->data, starts, sizeof(starts));
+        break;
+    }
+
+    case ANIMATION_FLAT_SEQUENCE: {
+        FlatSequenceAnimation* fa = (FlatSequenceAnimation*)a;
+        node.kind     = IMAGE_NODE_SEQUENCE;
+        node.n        = fa->n;
+        node.children = save_children(w, fa->children, fa->n);
+        node.data     = image_append(w->data, fa->starts, sizeof(float) * (fa->n+1));
+        break;
+    }
+
+    case ANIMATION_PARALLEL: {
+        ParallelAnimation* pa = (ParallelAnimation*)a;
+        children[0] = pa->a1;
+        children[1] = pa->a2;
+        node.kind     = IMAGE_NODE_PARALLEL;
+        node.n        = 2;
+        node.children = save_children(w, children, 2);
+        break;
+    }
+
+    case ANIMATION_DERIVED: {
+        DerivedAnimation* da = (DerivedAnimation*)a;
+        node.kind     = IMAGE_NODE_DERIVED;
+        node.n        = 1;
+        node.m        = da->n;
+        node.children = save_children(w, &da->child, 1);
+        node.data     = image_append(w->data, NULL, sizeof(ImageDerivedValue) * da->n);
+        for (j=0; j<da->n; j++)
+            save_derived_value(w, da->dvs[j], (ImageDerivedValue*)(w->data->data + node.data) + j);
+        break;
+    }
+
+    case ANIMATION_COMPILED:
+        return save_node(w, ((CompiledAnimation*)a)->source);
+
+    default:
+        w->ok = FALSE;
+        break;
+    }
+
+    return image_add(w, &node);
 }
 
-Animation* sequencen(Animation *a1, ...) {
-    Animation *result = a1;
+gboolean animation_save(Animation* a, const char* path, const char** names, void** outputs, const int* sizes, int n) {
+    g_assert(a != NULL);
+    g_assert(path != NULL);
+    g_assert_cmpint(n, >=, 0);
+
+    ImageWriter w;
+    w.nodes   = g_array_new(FALSE, TRUE, sizeof(ImageNode));
+    w.data    = g_array_new(FALSE, TRUE, 1);
+    w.names   = names;
+    w.outputs = outputs;
+    w.sizes   = sizes;
+    w.nslots  = n;
+    w.ok      = TRUE;
+
+    ImageHeader header;
+    memset(&header, 0, sizeof(ImageHeader));
+    memcpy(header.magic, IMAGE_MAGIC, 4);
+    header.version = IMAGE_VERSION;
+    header.root    = save_node(&w, a);
+    header.nslots  = n;
+    header.nnodes  = w.nodes->len;
+
+    /* the header, slots, nodes, their data and the slots' names */
+    GArray* image = g_array_new(FALSE, TRUE, 1);
+    image_append(image, &header, sizeof(ImageHeader));
+    header.slots  = image_append(image, NULL, sizeof(ImageSlot) * n);
+    header.nodes  = image_append(image, w.nodes->data, sizeof(ImageNode) * w.nodes->len);
+    guint32 data  = image_append(image, w.data->data, w.data->len);
 
-    va_list args;
-    va_start(args, a1);
-    while (TRUE) {
-        Animation* a = va_arg(args, Animation*);
-        if (a == NULL)
-            break;
-        result = sequence(result, a);
+    int i;
+    for (i=0; i<n; i++) {
+        guint32 name = image_append(image, names[i], strlen(names[i]) + 1);
+        ImageSlot* slot = (ImageSlot*)(image->data + header.slots) + i;
+        slot->name  = name;
+        slot->bytes = sizes[i];
     }
 
-    return result;
-}
+    for (i=0; i<w.nodes->len; i++) {
+        ImageNode* node = (ImageNode*)(image->data + header.nodes) + i;
+        node->children += data;
+        node->data     += data;
+    }
 
-/* parallel animation */
+    header.size = image->len;
+    memcpy(image->data, &header, sizeof(ImageHeader));
 
-typedef struct ParallelAnimationStruct {
-    Animation a;
-    Animation* a1;
-    Animation* a2;
-} ParallelAnimation;
+    gboolean ok = w.ok && g_file_set_contents(path, image->data, image->len, NULL);
 
-void parallel_animation_update(Animation* a, float f) {
-    ParallelAnimation* as = (ParallelAnimation*)a;
-    animation_update(as->a1, f);
-    animation_update(as->a2, f);
+    g_array_free(image, TRUE);
+    g_array_free(w.nodes, TRUE);
+    g_array_free(w.data, TRUE);
+    return ok;
 }
 
-void parallel_animation_free(Animation* a) {
-    ParallelAnimation* as = (ParallelAnimation*)a;
-    animation_free(as->a1);
-    animation_free(as->a2);
-    default_animation_free(a);
-}
+/* checking */
 
-float parallel_animation_duration(Animation* a) {
-    ParallelAnimation* as = (ParallelAnimation*)a;
-    return animation_duration(as->a1);
+/* whether bytes bytes at offset lie within size bytes, and offset is a multiple of align */
+gboolean image_within(guint64 offset, guint64 bytes, guint64 size, guint32 align) {
+    return offset % align == 0 && offset <= size && bytes <= size - offset;
 }
 
-Animation* parallel(Animation* a1, Animation* a2) {
-    g_assert(a1 != NULL);
-    g_assert(a2 != NULL);
-    g_assert_cmpfloat(animation_duration(a1), ==, animation_duration(a2));
-
-    ParallelAnimation* a = malloc(sizeof(ParallelAnimation));
-    a->a.update   = parallel_animation_update;
-    a->a.duration = parallel_animation_duration;
-    a->a.free     = parallel_animation_free;
-    a->a1 = a1;
-    a->a2 = a2;
-    return (Animation*)a;
+/* whether bytes bytes at offset lie within the given slot.  every value an image writes is a float or an int */
+gboolean image_check_output(const ImageHeader* header, const char* image, guint32 slot, guint32 offset, guint64 bytes) {
+    const ImageSlot* slots = (const ImageSlot*)(image + header->slots);
+    return slot < header->nslots && image_within(offset, bytes, slots[slot].bytes, sizeof(float));
 }
 
-Animation* paralleln(Animation *a1, ...) {
-    Animation *result = a1;
+/* whether the node's children all come before node i */
+gboolean image_check_children(const ImageHeader* header, const char* image, const ImageNode* node, guint32 i) {
+    guint32 j;
 
-    va_list args;
-    va_start(args, a1);
-    while (TRUE) {
-        Animation* a = va_arg(args, Animation*);
-        if (a == NULL)
-            break;
-        result = parallel(result, a);
-    }
+    if (!image_within(node->children, (guint64)node->n * sizeof(guint32), header->size, sizeof(guint32)))
+        return FALSE;
 
-    return result;
+    const guint32* children = (const guint32*)(image + node->children);
+    for (j=0; j<node->n; j++)
+        if (children[j] >= i)
+            return FALSE;
+
+    return TRUE;
 }
 
-Animation* parallelp(Animation *a1, Animation* a2) {
-    float d1 = animation_duration(a1), d2 = animation_duration(a2);
+gboolean image_check_transform(const ImageHeader* header, const char* image, const ImageNode* node) {
+    const char* data = image + node->data;
+    int j;
 
-    if (d1 < d2)
-        return parallel(pad_to(a1, d2), a2);
+    switch (node->m) {
+    case IMAGE_TRANSFORM_EXPONENT_INTEGER:
+        return node->param >= 0.0 && node->param <= EXPONENT_INTEGER_MAX && node->param == (float)(int)node->param;
 
-    if (d1 > d2)
-        return parallel(a1, pad_to(a2, d1));
+    case IMAGE_TRANSFORM_LUT:
+        return image_within(node->data, 8, header->size, 8) && *(const guint32*)data > 0 &&
+               image_within(node->data + 8, ((guint64)*(const guint32*)data + 1) * sizeof(float), header->size, sizeof(float));
 
-    return parallel(a1, a2);
+    case IMAGE_TRANSFORM_CUBIC_BEZIER: {
+        if (!image_within(node->data, sizeof(CubicBezierCurve), header->size, sizeof(float)))
+            return FALSE;
+
+        const CubicBezierCurve* cb = (const CubicBezierCurve*)data;
+        for (j=0; j<=CUBIC_BEZIER_SAMPLES; j++)
+            if (cb->first[j] < 0 || cb->first[j] > CUBIC_BEZIER_SAMPLES)
+                return FALSE;
+        return TRUE;
+    }
+
+    default:
+        return node->m < IMAGE_TRANSFORM_KINDS;
+    }
 }
 
-Animation* parallelpn(Animation *a1, ...) {
-    Animation *result = a1;
+/* whether node i refers only to memory within the image and its slots, and only to nodes before it */
+gboolean image_check_node(const ImageHeader* header, const char* image, guint32 i) {
+    const ImageNode* node = (const ImageNode*)(image + header->nodes) + i;
+    guint64 values = (guint64)node->n * sizeof(float);
+    guint32 j;
 
-    va_list args;
-    va_start(args, a1);
-    while (TRUE) {
-        Animation* a = va_arg(args, Animation*);
-        if (a == NULL)
-            break;
-        result = parallelp(result, a);
+    /* whatever n and m count takes at least 4 bytes each, which also keeps their products from overflowing */
+    if (node->n > header->size / sizeof(float) || node->m > header->size / sizeof(float) || !(node->duration >= 0.0))
+        return FALSE;
+
+    switch (node->kind) {
+    case IMAGE_NODE_NULL:
+        return TRUE;
+
+    case IMAGE_NODE_LINEARF:
+    case IMAGE_NODE_LINEARI:
+        return image_check_output(header, image, node->slot, node->offset, values) &&
+               image_within(node->data, 2 * values, header->size, sizeof(float));
+
+    case IMAGE_NODE_BEZIERF:
+        return node->m > 0 && image_check_output(header, image, node->slot, node->offset, values) &&
+               image_within(node->data, (guint64)node->n * node->m * sizeof(double), header->size, sizeof(double));
+
+    case IMAGE_NODE_SCALED:
+        return node->n == 1 && node->param > 0.0 && image_check_children(header, image, node, i);
+
+    case IMAGE_NODE_TRANSFORMED:
+        return node->n == 1 && image_check_children(header, image, node, i) && image_check_transform(header, image, node);
+
+    case IMAGE_NODE_SEQUENCE:
+        return node->n > 0 && image_check_children(header, image, node, i) &&
+               image_within(node->data, values + sizeof(float), header->size, sizeof(float));
+
+    case IMAGE_NODE_PARALLEL:
+        return image_check_children(header, image, node, i);
+
+    case IMAGE_NODE_DERIVED: {
+        if (node->n != 1 || !image_check_children(header, image, node, i) ||
+            !image_within(node->data, (guint64)node->m * sizeof(ImageDerivedValue), header->size, sizeof(guint32)))
+            return FALSE;
+
+        /* every kind of derived value reads and writes n floats or ints */
+        const ImageDerivedValue* dvs = (const ImageDerivedValue*)(image + node->data);
+        for (j=0; j<node->m; j++) {
+            values = (guint64)dvs[j].n * sizeof(float);
+            if (dvs[j].kind >= IMAGE_DERIVE_KINDS ||
+                !image_check_output(header, image, dvs[j].in_slot, dvs[j].in_offset, values) ||
+                !image_check_output(header, image, dvs[j].out_slot, dvs[j].out_offset, values))
+                return FALSE;
+        }
+        return TRUE;
     }
 
-    return result;
+    default:
+        return FALSE;
+    }
 }
 
-/* higher-level operations */
+/* whether the image could have been written by animation_save, as far as playing it safely depends on */
+gboolean image_check(const char* image, gsize size) {
+    const ImageHeader* header = (const ImageHeader*)image;
+    guint32 i;
 
-Animation* delay(Animation* a, float d) {
-    g_assert(a != NULL);
-    return sequence(scale(null_animation(), d), a);
-}
+    if (size < sizeof(ImageHeader) || memcmp(header->magic, IMAGE_MAGIC, 4) != 0 || header->version != IMAGE_VERSION ||
+        header->size != size || header->nnodes == 0 || header->root >= header->nnodes ||
+        !image_within(header->slots, (guint64)header->nslots * sizeof(ImageSlot), size, sizeof(guint32)) ||
+        !image_within(header->nodes, (guint64)header->nnodes * sizeof(ImageNode), size, sizeof(guint32)))
+        return FALSE;
 
-Animation* pad_by(Animation* a, float d) {
-    return sequence(a, scale(null_animation(), d));
-}
+    for (i=0; i<header->nnodes; i++)
+        if (!image_check_node(header, image, i))
+            return FALSE;
 
-Animation* pad_to(Animation* a, float d) {
-    return pad_by(a, d - animation_duration(a));
+    return TRUE;
 }
 
-Animation* identity(Animation* a) {
-    g_assert(a != NULL);
-    return transform(a, identity_transform());
-}
+/* loading */
 
-Animation* sinusoid(Animation* a) {
-    g_assert(a != NULL);
-    return transform(a, sinusoid_transform());
+typedef struct ImageAnimationStruct {
+    Animation a;
+    GMappedFile* file;
+    const char* image;
+    const ImageNode* nodes;
+    guint32 root;
+    guint32 nslots, nnodes;
+    char** bindings;    /* per slot, the output it is bound to.  follows the struct in the same block */
+    int* cursors;       /* per node, the child of a sequence that was active at the last update.  follows the bindings */
+} ImageAnimation;
+
+float image_transform(const ImageNode* node, const char* data, float f) {
+    /* the tables are indexed by time, which a damaged image could take outside [0, 1] */
+    float t = (f > 0.0f) ? ((f < 1.0f) ? f : 1.0f) : 0.0f;
+
+    switch (node->m) {
+    case IMAGE_TRANSFORM_IDENTITY:
+        return f;
+    case IMAGE_TRANSFORM_SINUSOID:
+        return sinusoid_transform_function(NULL, f);
+    case IMAGE_TRANSFORM_REVERSE:
+        return reverse_transform_function(NULL, f);
+    case IMAGE_TRANSFORM_EXPONENT:
+        return pow(f, node->param);
+    case IMAGE_TRANSFORM_EXPONENT_INTEGER:
+        return exponent_integer(f, (int)node->param);
+    case IMAGE_TRANSFORM_LUT:
+        return lut_lookup((const float*)(data + 8), *(const guint32*)data, t);
+    default:
+        return cubic_bezier_curve((const CubicBezierCurve*)data, t);
+    }
 }
 
-Animation* reverse(Animation* a) {
-    g_assert(a != NULL);
-    return transform(a, reverse_transform());
+/* as bezier_animationf_update, a value at a time */
+void image_bezier(float* v, const double* b, int n, int m, float f) {
+    int i, k, d = m - 1;
+    double w = 1.0, x = (f <= 0.5) ? f / (1.0 - f) : (1.0 - f) / f;
+
+    for (i=0; i<d; i++)
+        w *= (f <= 0.5) ? 1.0 - f : f;
+
+    for (k=0; k<n; k++) {
+        double acc;
+        if (f <= 0.5) {
+            acc = b[d*n + k];
+            for (i=d-1; i>=0; i--)
+                acc = acc * x + b[i*n + k];
+        } else {
+            acc = b[k];
+            for (i=1; i<=d; i++)
+                acc = acc * x + b[i*n + k];
+        }
+        v[k] = acc * w;
+    }
 }
 
-Animation* exponent(Animation* a, float f) {
-    g_assert(a != NULL);
-    g_assert_cmpfloat(f, !=, 0.0);
-    return transform(a, exponent_transform(f));
+void image_derive(ImageAnimation* ia, const ImageDerivedValue* dvs, int n) {
+    int i;
+    for (i=0; i<n; i++) {
+        const ImageDerivedValue* r = dvs + i;
+        void* in  = ia->bindings[r->in_slot] + r->in_offset;
+        void* out = ia->bindings[r->out_slot] + r->out_offset;
+
+        switch (r->kind) {
+        case IMAGE_DERIVE_CLAMP:
+            transform_kernels()->clamp(in, out, r->n, r->a, r->b);
+            break;
+        case IMAGE_DERIVE_AFFINE:
+            transform_kernels()->affine(in, out, r->n, r->a, r->b);
+            break;
+        case IMAGE_DERIVE_SIN:
+            transformv_sin(in, out, r->n);
+            break;
+        case IMAGE_DERIVE_COS:
+            transformv_cos(in, out, r->n);
+            break;
+        case IMAGE_DERIVE_ROUND:
+            transformv_round(in, out, r->n);
+            break;
+        case IMAGE_DERIVE_FTOI:
+            transformv_ftoi(in, out, r->n);
+            break;
+        default:
+            transformv_itof(in, out, r->n);
+            break;
+        }
+    }
 }
 
-/* derived values */
+void image_update_node(ImageAnimation* ia, guint32 i, float f) {
+    const ImageNode* node = ia->nodes + i;
+    const guint32* children = (const guint32*)(ia->image + node->children);
+    const char* data = ia->image + node->data;
+    int j;
+
+    switch (node->kind) {
+    case IMAGE_NODE_LINEARF: {
+        float* start = (float*)data;
+        linear_kernels()->f((float*)(ia->bindings[node->slot] + node->offset), start, start + node->n, node->n, f);
+        break;
+    }
 
-typedef void (*UpdateDerivedValueFunction)(DerivedValue*);
-typedef void (*FreeDerivedValueFunction)(DerivedValue*);
+    case IMAGE_NODE_LINEARI: {
+        int* start = (int*)data;
+        linear_kernels()->i((int*)(ia->bindings[node->slot] + node->offset), start, start + node->n, node->n, f);
+        break;
+    }
 
-struct DerivedValueStruct {
-    UpdateDerivedValueFunction update;
-    FreeDerivedValueFunction free;
-};
+    case IMAGE_NODE_BEZIERF:
+        image_bezier((float*)(ia->bindings[node->slot] + node->offset), (const double*)data, node->n, node->m, f);
+        break;
 
-void derived_value_update(DerivedValue* dv) {
-    dv->update(dv);
-}
+    case IMAGE_NODE_SCALED:
+        image_update_node(ia, children[0], f / node->param);
+        break;
 
-void derived_value_free(DerivedValue* dv) {
-    dv->free(dv);
-}
+    case IMAGE_NODE_TRANSFORMED:
+        image_update_node(ia, children[0], image_transform(node, data, f / node->duration) * node->duration);
+        break;
 
-void default_derived_value_free(DerivedValue* dv) {
-    free(dv);
-}
+    case IMAGE_NODE_SEQUENCE: {
+        const float* starts = (const float*)data;
+        j = ia->cursors[i] = sequence_find(starts, node->n, ia->cursors[i], f);
 
-/* concrete derived values */
+        float t = f - starts[j], d = ia->nodes[children[j]].duration;
+        image_update_node(ia, children[j], t < d ? t : d);
+        break;
+    }
 
-typedef struct ConcreteDerivedValueStruct {
-    DerivedValue dv;
-    void* transform;
-    int n;
-    void* in;
-    void* out;
-} ConcreteDerivedValue;
+    case IMAGE_NODE_PARALLEL:
+        for (j=0; j<node->n; j++)
+            image_update_node(ia, children[j], f);
+        break;
 
-void concrete_derived_value_update(DerivedValue* dv) {
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    ((TransformN)cdv->transform)(cdv->n, cdv->in, cdv->out);
+    case IMAGE_NODE_DERIVED:
+        image_update_node(ia, children[0], f);
+        image_derive(ia, (const ImageDerivedValue*)data, node->m);
+        break;
+
+    default:
+        break;
+    }
 }
 
-void concrete_derived_value_update_ff(DerivedValue* dv) {
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    *((float*)cdv->out) = ((TransformFF)cdv->transform)(*((float*)cdv->in));
+void image_animation_update(Animation* a, float f) {
+    ImageAnimation* ia = (ImageAnimation*)a;
+    image_update_node(ia, ia->root, f);
 }
 
-void concrete_derived_value_update_fi(DerivedValue* dv) {
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    *((int*)cdv->out) = ((TransformFI)cdv->transform)(*((float*)cdv->in));
+float image_animation_duration(Animation* a) {
+    ImageAnimation* ia = (ImageAnimation*)a;
+    return ia->nodes[ia->root].duration;
 }
 
-void concrete_derived_value_update_if(DerivedValue* dv) {
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    *((float*)cdv->out) = ((TransformIF)cdv->transform)(*((int*)cdv->in));
+void image_file_unref(void* file) {
+    g_mapped_file_unref(file);
 }
 
-void concrete_derived_value_update_ii(DerivedValue* dv) {
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    *((int*)cdv->out) = ((TransformII)cdv->transform)(*((int*)cdv->in));
+void image_animation_free(Animation* a) {
+    ImageAnimation* ia = (ImageAnimation*)a;
+    g_mapped_file_unref(ia->file);
+    default_animation_free(a);
 }
 
-void concrete_derived_value_update_ffn(DerivedValue* dv) {
-    int i;
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    for (i = 0; i < cdv->n; i++)
-        ((float*)cdv->out)[i] = ((TransformFF)cdv->transform)(((float*)cdv->in)[i]);
+/* the output named name, if it has room for bytes bytes */
+int image_find_output(const char* name, int bytes, const char** names, const int* sizes, int n) {
+    int j;
+    for (j=0; j<n; j++)
+        if (strcmp(names[j], name) == 0 && sizes[j] >= bytes)
+            return j;
+    return -1;
 }
 
-void concrete_derived_value_update_fin(DerivedValue* dv) {
+Animation* animation_load(const char* path, const char** names, void** outputs, const int* sizes, int n) {
+    g_assert(path != NULL);
+    g_assert_cmpint(n, >=, 0);
+
+    GMappedFile* file = g_mapped_file_new(path, FALSE, NULL);
+    if (file == NULL)
+        return NULL;
+
+    const char* image = g_mapped_file_get_contents(file);
+    gsize size = g_mapped_file_get_length(file);
+    const ImageHeader* header = (const ImageHeader*)image;
+
+    if (!image_check(image, size)) {
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+
+    ImageAnimation* ia = animation_alloc(sizeof(ImageAnimation) + sizeof(char*) * header->nslots + sizeof(int) * header->nnodes);
+    ia->file     = file;
+    ia->image    = image;
+    ia->nodes    = (const ImageNode*)(image + header->nodes);
+    ia->root     = header->root;
+    ia->nslots   = header->nslots;
+    ia->nnodes   = header->nnodes;
+    ia->bindings = (char**)(ia + 1);
+    ia->cursors  = (int*)(ia->bindings + header->nslots);
+    memset(ia->cursors, 0, sizeof(int) * header->nnodes);
+
     int i;
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    for (i = 0; i < cdv->n; i++)
-        ((int*)cdv->out)[i] = ((TransformFI)cdv->transform)(((float*)cdv->in)[i]);
+    for (i=0; i<header->nslots; i++) {
+        const ImageSlot* slot = (const ImageSlot*)(image + header->slots) + i;
+        int j = -1;
+        if (slot->name < size && memchr(image + slot->name, '\0', size - slot->name) != NULL)
+            j = image_find_output(image + slot->name, slot->bytes, names, sizes, n);
+
+        if (j < 0) {
+            g_mapped_file_unref(file);
+            if (current_arena() == NULL)
+                free(ia);
+            return NULL;
+        }
+
+        ia->bindings[i] = outputs[j];
+    }
+
+    animation_adopt(file, image_file_unref);
+    animation_init(&ia->a, ANIMATION_IMAGE, image_animation_update, image_animation_duration, image_animation_free, default_animation_visit);
+    return (Animation*)ia;
 }
 
-void concrete_derived_value_update_ifn(DerivedValue* dv) {
-    int i;
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    for (i = 0; i < cdv->n; i++)
-        ((float*)cdv->out)[i] = ((TransformIF)cdv->transform)(((int*)cdv->in)[i]);
+/* tree statistics and profiles - a walk over the tree in pre-order.  bytes are counted from what each kind of node
+ * allocates, rather than tracked as it allocates, so they are available whether or not profiling is built in.
+ */
+
+static const char* animation_kind_names[] = {
+    "null", "linearf", "lineari", "bezierf", "splinef", "keyframesf", "scaled", "transformed", "sequence",
+    "flat_sequence", "parallel", "derived", "compiled", "baked", "image"
+};
+
+size_t time_transform_bytes(TimeTransform* t) {
+    if (t->f == exponent_transform_function || t->f == exponent_transform_function_integer)
+        return sizeof(exponentTransform);
+    if (t->f == lut_transform_function)
+        return sizeof(LutTransform) + sizeof(float) * (((LutTransform*)t)->size + 1);
+    if (t->f == cubic_bezier_transform_function)
+        return sizeof(CubicBezierTransform);
+
+    if (t->f == chain_transform_function) {
+        ChainTransform* c = (ChainTransform*)t;
+        size_t bytes = sizeof(ChainTransform) + sizeof(TimeTransform*) * c->n;
+        int i;
+        for (i=0; i<c->n; i++)
+            bytes += time_transform_bytes(c->parts[i]);
+        return bytes;
+    }
+
+    return sizeof(TimeTransform);
 }
 
-void concrete_derived_value_update_iin(DerivedValue* dv) {
+/* the bytes a node allocates for itself and the data, transforms and derived values it owns, but not its children */
+size_t animation_node_bytes(Animation* a) {
     int i;
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)dv;
-    for (i = 0; i < cdv->n; i++)
-        ((int*)cdv->out)[i] = ((TransformII)cdv->transform)(((int*)cdv->in)[i]);
-}
 
-DerivedValue* mk_cdv(UpdateDerivedValueFunction update, void* f, int n, void* in, void* out) {
-    ConcreteDerivedValue *cdv = (ConcreteDerivedValue*)malloc(sizeof(ConcreteDerivedValue));
-    cdv->dv.update = update;
-    cdv->dv.free   = default_derived_value_free;
-    cdv->transform = f;
-    cdv->n         = n;
-    cdv->in        = in;
-    cdv->out       = out;
-    return (DerivedValue*)cdv;
+    switch (a->kind) {
+    case ANIMATION_LINEARF: {
+        LinearAnimationF* la = (LinearAnimationF*)a;
+        return sizeof(LinearAnimationF) + ((la->start != la->storage) ? 2 * sizeof(float) * la->n : 0);
+    }
+    case ANIMATION_LINEARI: {
+        LinearAnimationI* la = (LinearAnimationI*)a;
+        return sizeof(LinearAnimationI) + ((la->start != la->storage) ? 2 * sizeof(int) * la->n : 0);
+    }
+    case ANIMATION_BEZIERF: {
+        BezierAnimationF* ba = (BezierAnimationF*)a;
+        return sizeof(BezierAnimationF) + sizeof(double) * (ba->m + 1) * ba->n;
+    }
+    case ANIMATION_SPLINEF: {
+        SplineAnimationF* sa = (SplineAnimationF*)a;
+        return sizeof(SplineAnimationF) + sizeof(float) * 4 * sa->segments * sa->n;
+    }
+    case ANIMATION_KEYFRAMESF: {
+        KeyframeAnimationF* ka = (KeyframeAnimationF*)a;
+        return sizeof(KeyframeAnimationF) + sizeof(float) * ka->count * (1 + 2 * ka->n) + ka->count;
+    }
+    case ANIMATION_SCALED:
+        return sizeof(ScaledAnimation);
+    case ANIMATION_TRANSFORMED:
+        return sizeof(TransformedAnimation) + time_transform_bytes(((TransformedAnimation*)a)->t);
+    case ANIMATION_SEQUENCE:
+        return sizeof(SequenceAnimation);
+    case ANIMATION_FLAT_SEQUENCE: {
+        FlatSequenceAnimation* fa = (FlatSequenceAnimation*)a;
+        return sizeof(FlatSequenceAnimation) + sizeof(Animation*) * fa->n + sizeof(float) * (fa->n + 1);
+    }
+    case ANIMATION_PARALLEL:
+        return sizeof(ParallelAnimation);
+    case ANIMATION_DERIVED: {
+        DerivedAnimation* da = (DerivedAnimation*)a;
+        size_t bytes = sizeof(DerivedAnimation) + (sizeof(DerivedValue*) + sizeof(char*)) * da->n;
+        for (i=0; i<da->n; i++)
+            bytes += sizeof(ConcreteDerivedValue) + da->dvs[i]->in_bytes;
+        return bytes;
+    }
+    case ANIMATION_COMPILED: {
+        CompiledAnimation* ca = (CompiledAnimation*)a;
+        return sizeof(CompiledAnimation) + sizeof(AnimationInstruction) * ca->n + (sizeof(float) + sizeof(int)) * ca->nentries +
+            sizeof(float) * ca->nregisters;
+    }
+    case ANIMATION_BAKED: {
+        BakedAnimation* ba = (BakedAnimation*)a;
+        return sizeof(BakedAnimation) + (sizeof(float*) + sizeof(int)) * ba->noutputs + sizeof(float) * ba->k * ba->width;
+    }
+    case ANIMATION_IMAGE: {
+        ImageAnimation* ia = (ImageAnimation*)a;
+        return sizeof(ImageAnimation) + sizeof(char*) * ia->nslots + sizeof(int) * ia->nnodes;
+    }
+    default:
+        return sizeof(NullAnimation);
+    }
 }
 
-DerivedValue* derive(TransformN f, int n, void* in, void* out) {
-    return mk_cdv(concrete_derived_value_update, f, n, in, out);
-}
+typedef struct ProfileWalkStruct {
+    int depth;
+    AnimationStats stats;
+    GArray* nodes;    /* AnimationNodeProfile, or NULL if only the statistics are wanted */
+    gboolean reset;
+} ProfileWalk;
+
+void profile_walk_visitor(Animation* a, void* data) {
+    ProfileWalk* w = data;
+
+    w->depth++;
+    w->stats.nodes++;
+    w->stats.bytes += animation_node_bytes(a);
+    if (w->depth > w->stats.max_depth)
+        w->stats.max_depth = w->depth;
+    if (a->kind == ANIMATION_NULL)
+        w->stats.null_nodes++;
+    else if (a->is_null)
+        w->stats.pad_nodes++;
+
+    if (w->nodes != NULL) {
+        AnimationNodeProfile node;
+        memset(&node, 0, sizeof(AnimationNodeProfile));
+        node.kind  = animation_kind_names[a->kind];
+        node.depth = w->depth;
+#ifdef ANIM_PROFILE
+        node.calls            = a->profile.calls;
+        node.update_seconds   = a->profile.update_seconds;
+        node.duration_calls   = a->profile.duration_calls;
+        node.duration_seconds = a->profile.duration_seconds;
+#endif
+        g_array_append_val(w->nodes, node);
+    }
 
-DerivedValue* deriveff(TransformFF f, float* in, float* out) {
-    return mk_cdv(concrete_derived_value_update_ff, f, 1, in, out);
-}
+    if (w->reset)
+        PROFILE_RESET(a);
 
-DerivedValue* derivefi(TransformFI f, float* in, int* out) {
-    return mk_cdv(concrete_derived_value_update_fi, f, 1, in, out);
+    a->visit(a, profile_walk_visitor, w);
+    w->depth--;
 }
 
-DerivedValue* deriveif(TransformIF f, int* in, float* out) {
-    return mk_cdv(concrete_derived_value_update_if, f, 1, in, out);
-}
+ProfileWalk profile_walk(Animation* a, GArray* nodes, gboolean reset) {
+    g_assert(a != NULL);
 
-DerivedValue* deriveii(TransformII f, int* in, int* out) {
-    return mk_cdv(concrete_derived_value_update_ii, f, 1, in, out);
+    ProfileWalk w;
+    memset(&w, 0, sizeof(ProfileWalk));
+    w.nodes = nodes;
+    w.reset = reset;
+    profile_walk_visitor(a, &w);
+    return w;
 }
 
-DerivedValue* mapderiveff(TransformFF f, int n, float* in, float* out) {
-    return mk_cdv(concrete_derived_value_update_ffn, f, n, in, out);
+gboolean animation_profiling() {
+#ifdef ANIM_PROFILE
+    return TRUE;
+#else
+    return FALSE;
+#endif
 }
 
-DerivedValue* mapderivefi(TransformFI f, int n, float* in, int* out) {
-    return mk_cdv(concrete_derived_value_update_fin, f, n, in, out);
+AnimationStats animation_stats(Animation* a) {
+    return profile_walk(a, NULL, FALSE).stats;
 }
 
-DerivedValue* mapderiveif(TransformIF f, int n, int* in, float* out) {
-    return mk_cdv(concrete_derived_value_update_ifn, f, n, in, out);
-}
+int animation_profile(Animation* a, AnimationNodeProfile* nodes, int n) {
+    GArray* profiles = g_array_new(FALSE, FALSE, sizeof(AnimationNodeProfile));
+    int count = profile_walk(a, profiles, FALSE).stats.nodes;
 
-DerivedValue* mapderiveii(TransformII f, int n, int* in, int* out) {
-    return mk_cdv(concrete_derived_value_update_iin, f, n, in, out);
+    memcpy(nodes, profiles->data, sizeof(AnimationNodeProfile) * MIN(n, count));
+    g_array_free(profiles, TRUE);
+    return count;
 }
 
-/* derived value animation */
+void animation_profile_reset(Animation* a) {
+    profile_walk(a, NULL, TRUE);
+}
 
-typedef struct DerivedAnimationStruct {
-    Animation a;
-    Animation* child;
-    DerivedValue* dv;
-} DerivedAnimation;
+char* animation_profile_text(Animation* a) {
+    GArray* profiles = g_array_new(FALSE, FALSE, sizeof(AnimationNodeProfile));
+    AnimationStats stats = profile_walk(a, profiles, FALSE).stats;
+    GString* s = g_string_new(NULL);
+    int i;
 
-void derived_animation_update(Animation* a, float f) {
-    DerivedAnimation* da = (DerivedAnimation*)a;
-    animation_update(da->child, f);
-    derived_value_update(da->dv);
-}
+    g_string_append_printf(s, "nodes %d, max depth %d, bytes %lu, null %d, pad %d\n",
+                           stats.nodes, stats.max_depth, (unsigned long)stats.bytes, stats.null_nodes, stats.pad_nodes);
 
-void derived_animation_free(Animation* a) {
-    DerivedAnimation* da = (DerivedAnimation*)a;
-    derived_value_free(da->dv);
-    animation_free(da->child);
-}
+    for (i=0; i<profiles->len; i++) {
+        AnimationNodeProfile* node = &g_array_index(profiles, AnimationNodeProfile, i);
+        g_string_append_printf(s, "%*s%s", 2 * (node->depth - 1), "", node->kind);
+        if (animation_profiling())
+            g_string_append_printf(s, ": %lu updates in %.9fs, %lu durations in %.9fs",
+                                   node->calls, node->update_seconds, node->duration_calls, node->duration_seconds);
+        g_string_append_c(s, '\n');
+    }
 
-float derived_animation_duration(Animation* a) {
-    DerivedAnimation* da = (DerivedAnimation*)a;
-    return animation_duration(da->child);
+    g_array_free(profiles, TRUE);
+    return g_string_free(s, FALSE);
 }
 
-Animation* attach(Animation* a, DerivedValue *dv) {
-    g_assert(a != NULL);
-    g_assert(dv != NULL);
-
-    DerivedAnimation* da = malloc(sizeof(DerivedAnimation));
-    da->a.update   = derived_animation_update;
-    da->a.duration = derived_animation_duration;
-    da->a.free     = derived_animation_free;
-    da->child = a;
-    da->dv    = dv;
-    return (Animation*)da;
-}
+char* animation_profile_json(Animation* a) {
+    GArray* profiles = g_array_new(FALSE, FALSE, sizeof(AnimationNodeProfile));
+    AnimationStats stats = profile_walk(a, profiles, FALSE).stats;
+    GString* s = g_string_new(NULL);
+    int i;
 
-Animation* attachn(Animation *a, DerivedValue *dv1, ...) {
-    Animation *result = attach(a, dv1);
+    g_string_append_printf(s, "{\"nodes\": %d, \"max_depth\": %d, \"bytes\": %lu, \"null_nodes\": %d, \"pad_nodes\": %d, \"profiling\": %s, \"profile\": [",
+                           stats.nodes, stats.max_depth, (unsigned long)stats.bytes, stats.null_nodes, stats.pad_nodes,
+                           animation_profiling() ? "true" : "false");
 
-    va_list args;
-    va_start(args, dv1);
-    while (TRUE) {
-        DerivedValue* dv = va_arg(args, DerivedValue*);
-        if (dv == NULL)
-            break;
-        result = attach(result, dv);
+    for (i=0; i<profiles->len; i++) {
+        AnimationNodeProfile* node = &g_array_index(profiles, AnimationNodeProfile, i);
+        g_string_append_printf(s, "%s\n  {\"kind\": \"%s\", \"depth\": %d, \"calls\": %lu, \"update_seconds\": %.9f, \"duration_calls\": %lu, \"duration_seconds\": %.9f}",
+                               (i > 0) ? "," : "", node->kind, node->depth, node->calls, node->update_seconds, node->duration_calls, node->duration_seconds);
     }
 
-    return result;
+    g_string_append(s, "\n]}\n");
+    g_array_free(profiles, TRUE);
+    return g_string_free(s, FALSE);
 }
@@ -6,17 +6,26 @@
 /* Animations
  *
  * Animations change values over time.  All primitive animations take 1 unit of time.
+ *
+ * Parts of an animation whose values do not depend on time (e.g. a linearf that starts and ends at the same values, or the null animation)
+ * are skipped once they have written their values, until a sequence switches back to them.
  */
 
 struct AnimationStruct;
 typedef struct AnimationStruct Animation;
 
 void  animation_update(Animation* a, float time);
-float animation_duration(Animation* a);
+float animation_duration(Animation* a);   /* durations are computed once, when a node is built */
+void  animation_invalidate(Animation* a); /* recompute the cached durations of a after modifying it in place.  this unseals a */
+void  animation_seal(Animation* a);       /* validate a once so that its nodes are updated without per-node checks, and holds are skipped once written */
 void  animation_free(Animation* a);
 
 Animation* null_animation(); /* the null animation does nothing */
 
+/* Holds, and linear animations whose start and end are equal, write on every update.  Within a sealed tree they write once and are
+ * skipped until their sequence switches back to them or a sibling writes the same value, so a value the caller writes to v between
+ * updates stays until then.
+ */
 Animation* holdf(float* v, int n, float* c); /* hold v at the constant n-dimensional value c */
 Animation* holdi(int*   v, int n, int*   c); /* hold v at the constant n-dimensional value c */
 
@@ -29,7 +38,26 @@ Animation* lineari(int*   v, int n, int*   start, int*   end); /* animate n-dime
 Animation* linearf1(float* v, float start, float end); /* animate value v from start to end */
 Animation* lineari1(int*   v, int   start, int   end); /* animate value v from start to end */
 
-Animation* bezierf(float* v, int n, int m, float** control_points); /* animate n-dimensional point v along bezier with m control points */
+/* as linearf and lineari, but v, start and end must be 32-byte aligned (e.g. from posix_memalign, as start and end are released with free) */
+Animation* linearfa(float* v, int n, float* start, float* end);
+Animation* linearia(int*   v, int n, int*   start, int*   end);
+
+Animation* bezierf(float* v, int n, int m, float** control_points); /* animate n-dimensional point v along bezier with m control points.  the control points are freed immediately */
+
+/* animate n-dimensional point v along a spline through k points, each segment taking an equal share of time.  the points are freed immediately */
+Animation* catmullromf(float* v, int n, int k, float** points);    /* catmull-rom spline, passing through every point */
+Animation* bsplinef(float* v, int n, int k, float** points);       /* uniform cubic b-spline, passing through the first and last points */
+Animation* naturalsplinef(float* v, int n, int k, float** points); /* natural cubic spline, passing through every point */
+
+typedef enum {
+    KEYFRAME_STEP,   /* hold the key's value until the next key */
+    KEYFRAME_LINEAR, /* interpolate linearly to the next key */
+    KEYFRAME_CUBIC   /* interpolate smoothly to the next key */
+} KeyframeMode;
+
+/* animate n-dimensional point v through count keys, key i being values[i*n .. i*n+n-1] at times[i], reached from key i-1 as modes[i-1] says.
+ * times must increase, and the animation lasts from the first time to the last.  modes may be NULL for linear keys.  the arrays are copied */
+Animation* keyframesf(float* v, int n, int count, float* times, float* values, KeyframeMode* modes);
 
 
 
@@ -48,6 +76,9 @@ TimeTransform* sinusoid_transform();       /* time varies as the (sin(x)+1)/2 fo
 TimeTransform* reverse_transform();        /* reverses time within an animation */
 TimeTransform* exponent_transform(float);  /* time varies as x^n leading to animations that accelerate (for n>1) or decellerate (for n<1) */
 
+TimeTransform* lut_transform(TimeTransform* t, int size);                    /* t sampled at size+1 points and interpolated linearly.  t is freed */
+TimeTransform* cubic_bezier_transform(float x1, float y1, float x2, float y2); /* the css cubic-bezier easing curve.  all four must be in [0, 1] */
+
 
 /* Primitive Modifiers
  *
@@ -61,6 +92,7 @@ Animation* sequence(Animation* a1, Animation* a2); /* perform two animations in
 Animation* parallel(Animation* a1, Animation* a2); /* perform two animations in parallel */
 
 Animation* sequencen(Animation *a1, ...); /* sequence a null-terminated list of animations */
+Animation* sequencev(Animation** as, int n); /* sequence an array of n animations.  the array itself is copied */
 Animation* paralleln(Animation *a1, ...); /* parallel a null-terminated list of animations */
 
 Animation* parallelp(Animation *a1, Animation* a2); /* parallel two animations, padding the shorter */
@@ -82,23 +114,227 @@ Animation* reverse(Animation *a);           /* apply the reverse transformation
 Animation* exponent(Animation* a, float f); /* apply the exponent transformation to an animation */
 
 
+/* Compilation
+ *
+ * A compiled animation evaluates a tree from a flat instruction array, with scale factors and sequence offsets folded in.
+ */
+
+Animation* animation_compile(Animation* a); /* compile an animation.  the result takes ownership of a */
+
+
+/* Optimization
+ *
+ * Rewrite a tree into an equivalent one with fewer nodes: nested scales multiply, identities go, reverses cancel, nested
+ * time transforms become one, and nested sequences become one with each run of nulls merged.  Nodes allocated from an arena are left as they are.
+ */
+
+Animation* animation_optimize(Animation* a); /* optimize an animation, returning its replacement.  a is consumed, and the result is not sealed */
+
+
+/* Batch Sampling
+ *
+ * Sample an animation at many times at once.  The caller lists the float outputs it wants, noutputs of them with outputs[j] holding sizes[j] values,
+ * and row i of the buffer (stride floats apart) receives those outputs, packed in order, as they would be after animation_update(a, times[i]).
+ * Times are applied in order, and the animated values are left as animation_update(a, times[count-1]) would leave them.
+ */
+
+void animation_sample_batch(Animation* a, const float* times, int count, float** outputs, const int* sizes, int noutputs, float* buffer, int stride);
+
+
+/* Baking
+ *
+ * A baked animation replays the listed outputs of another animation from samples taken sample_rate times per unit of time,
+ * interpolating linearly between them.  Outputs are given as for animation_sample_batch.
+ */
+
+Animation* animation_bake(Animation* a, float sample_rate, float** outputs, const int* sizes, int noutputs); /* bake a.  a is not freed */
+float      animation_bake_error(Animation* baked, Animation* source); /* the largest difference between baked and source midway between samples */
+
+
+/* Animation Instances
+ *
+ * One template animation played by many instances.  The template is built once, writing to outputs given as for animation_sample_batch,
+ * and each instance has its own targets (one per output, of the same size), time offset and rate.  At time t an instance samples the
+ * template at (t - offset) * rate, clamped to its duration, and the template is evaluated once for each distinct time sampled, in increasing order.
+ * An output the template does not write at some time keeps the value it had at the time sampled before.
+ */
+
+struct AnimationInstancesStruct;
+typedef struct AnimationInstancesStruct AnimationInstances;
+
+AnimationInstances* animation_instances_new(Animation* a, float** outputs, const int* sizes, int noutputs); /* the instances take ownership of a */
+int                 animation_instances_add(AnimationInstances*, float** targets, float offset, float rate); /* add an instance, returning its index.  the targets array is copied */
+void                animation_instances_remove(AnimationInstances*, int instance); /* its index may be reused by a later add */
+gboolean            animation_instances_update(AnimationInstances*, float time);   /* update every instance.  returns TRUE if more animation remains. */
+void                animation_instances_free(AnimationInstances*);                 /* free the instances and the template */
+
+
+/* Serialization
+ *
+ * An animation image is a tree saved to a file that is played by mapping it into memory, without parsing or rebuilding its nodes.
+ * The values the tree writes must lie within n named outputs, outputs[j] being sizes[j] bytes named names[j], and a loaded image writes
+ * to whatever outputs are given those names, so one image can animate many objects.  Images hold null, linear, bezier, scaled,
+ * transformed, sequence, parallel and derived nodes (with the built-in clamp, affine and array transforms), and compiled animations
+ * are saved as their source.  An image must be loaded on a machine of the same byte order.  Loading checks
+ * every node once, so a damaged image is refused rather than reading or writing outside the file and the outputs.
+ */
+
+gboolean   animation_save(Animation* a, const char* path, const char** names, void** outputs, const int* sizes, int n); /* FALSE if a cannot be saved, or the file written */
+Animation* animation_load(const char* path, const char** names, void** outputs, const int* sizes, int n); /* NULL if the file is not a valid image, or an output it names is missing or too small */
+
+
+/* Statistics and Profiling
+ *
+ * The statistics of a tree describe its shape and the memory its nodes hold.  When the library is built with ANIM_PROFILE
+ * (configure --enable-profile), each node also counts its updates and duration computations and the time spent in them,
+ * its children's included.  Built without it, nothing is counted and the counts read as zero.
+ * Nodes are listed in pre-order, the root at depth 1.  Text and JSON dumps are freed with g_free.
+ */
+
+typedef struct AnimationStatsStruct {
+    int nodes;
+    int max_depth;
+    size_t bytes;     /* held by the nodes and the data, transforms and derived values they own */
+    int null_nodes;   /* null animations */
+    int pad_nodes;    /* other nodes that write nothing, like the scaled nulls of delay and pad_by */
+} AnimationStats;
+
+typedef struct AnimationNodeProfileStruct {
+    const char* kind;
+    int depth;
+    unsigned long calls;
+    double update_seconds;
+    unsigned long duration_calls;
+    double duration_seconds;
+} AnimationNodeProfile;
+
+gboolean       animation_profiling();                                                /* whether the library counts updates */
+AnimationStats animation_stats(Animation* a);
+int            animation_profile(Animation* a, AnimationNodeProfile* nodes, int n);  /* fill in up to n nodes' profiles, returning the number of nodes */
+void           animation_profile_reset(Animation* a);                                /* zero the counts of a tree */
+char*          animation_profile_text(Animation* a);                                 /* the statistics, then a line per node indented by depth */
+char*          animation_profile_json(Animation* a);
+
+
+/* Arenas
+ *
+ * While an arena is pushed, animations, time transformations and derived values are allocated from it, and so is the memory they own.
+ * Freeing the arena releases them all at once; animation_free and derived_value_free do nothing for them.  Heap memory passed to
+ * a constructor while an arena is pushed (e.g. the start and end arrays of linearf) is released with the arena.  Each thread pushes
+ * and pops its own arenas, and an arena may be pushed only once at a time, on one thread.
+ */
+
+struct AnimationArenaStruct;
+typedef struct AnimationArenaStruct AnimationArena;
+
+AnimationArena* animation_arena_new(size_t block_size); /* create an arena that allocates block_size bytes at a time (0 for the default) */
+void            animation_arena_push(AnimationArena*);  /* allocate from the arena until the matching pop */
+void            animation_arena_pop();                  /* return to the arena pushed before, or to the heap */
+void            animation_arena_free(AnimationArena*);  /* free everything allocated from the arena.  it must not be pushed */
+
+
+/* Animation Clock
+ *
+ * An Animation Clock holds the time, in seconds, as of its last tick.  Runners on a clock read that time rather than querying it,
+ * so ticking once per frame gives every runner the same time for the cost of one query.
+ */
+
+struct AnimationClockStruct;
+typedef struct AnimationClockStruct AnimationClock;
+
+AnimationClock* animation_clock_monotonic();                     /* a clock that reads the monotonic system time when ticked */
+AnimationClock* animation_clock_manual();                        /* a clock that only moves with animation_clock_advance */
+AnimationClock* animation_clock_fixed(float step);               /* a clock that moves step seconds each tick */
+void            animation_clock_tick(AnimationClock*);           /* move the clock to the current time, or by one step */
+void            animation_clock_advance(AnimationClock*, float); /* move a manual or fixed clock forward by some seconds */
+double          animation_clock_time(AnimationClock*);           /* the time as of the last tick.  a double, as monotonic time counts from boot */
+void            animation_clock_free(AnimationClock*);
+
+
 /* Animation Runner
  *
  * Animation Runners keep track of the start time of an animation and keep it up to date.
+ * Runners created without a clock query the monotonic system time on each start and update.
  */
 
 struct AnimationRunnerStruct;
 typedef struct AnimationRunnerStruct AnimationRunner;
 
 AnimationRunner* animation_runner(Animation*);              /* create a runner for an animation */
+AnimationRunner* animation_runner_with_clock(Animation*, AnimationClock*); /* create a runner that reads a clock.  the clock is not freed with it */
 void             animation_runner_start(AnimationRunner*);  /* start the animation at the current time */
 gboolean         animation_runner_update(AnimationRunner*); /* update based on the current time.  returns TRUE if more animation remains. */
 void             animation_runner_free(AnimationRunner*);   /* free the runner and its animation */
 
 
+/* Animation Timeline
+ *
+ * An Animation Timeline starts runners at scheduled times, updates only those that have started, and frees them when they finish.
+ * The timeline's clock (or, without one, the monotonic system time) is used in place of the runners' own clocks.
+ */
+
+struct AnimationTimelineStruct;
+typedef struct AnimationTimelineStruct AnimationTimeline;
+
+typedef void (*AnimationCompletionFunction)(AnimationRunner*, void* data); /* called as a runner finishes, before it is freed */
+
+AnimationTimeline* animation_timeline_new(AnimationClock*); /* create a timeline.  the clock may be NULL, and is not freed with the timeline */
+void               animation_timeline_add(AnimationTimeline*, AnimationRunner*, float delay, AnimationCompletionFunction, void* data); /* start a runner delay seconds from now.  the timeline takes ownership of it */
+gboolean           animation_timeline_update(AnimationTimeline*); /* update the started runners and retire the finished ones.  returns TRUE if more animation remains. */
+void               animation_timeline_free(AnimationTimeline*);   /* free the timeline and its runners */
+
+
+/* Animation Scheduler
+ *
+ * An Animation Scheduler owns many started runners and updates them all on a pool of threads.  Runners created without a clock share
+ * one query of the time per update; other runners read their clocks, which the caller ticks.
+ * Runners declared to conflict (e.g. because they write the same values) are never updated at the same time.
+ * Runners and conflicts may only be added between updates.
+ */
+
+struct AnimationSchedulerStruct;
+typedef struct AnimationSchedulerStruct AnimationScheduler;
+
+AnimationScheduler* animation_scheduler_new(int nthreads);                                                  /* create a scheduler.  0 threads for one per processor */
+void                animation_scheduler_add(AnimationScheduler*, AnimationRunner*);                         /* add a runner.  the scheduler takes ownership of it */
+void                animation_scheduler_conflict(AnimationScheduler*, AnimationRunner*, AnimationRunner*);   /* never update the two runners at the same time */
+gboolean            animation_scheduler_update(AnimationScheduler*);                                        /* update every runner, freeing the finished ones.  returns TRUE if more animation remains. */
+void                animation_scheduler_free(AnimationScheduler*);                                          /* free the scheduler and its runners */
+
+
+/* Animation Tween Pool
+ *
+ * A Tween Pool updates many tweens of single values at once, without building an animation for each.  A tween moves its target from start
+ * to end over duration seconds from start_time, eased as its easing says, and is removed once it has written its end value.
+ * Tweens whose start time has not come do not write their targets.
+ */
+
+struct AnimationTweenPoolStruct;
+typedef struct AnimationTweenPoolStruct AnimationTweenPool;
+
+typedef enum {
+    TWEEN_LINEAR,    /* as linearf1 */
+    TWEEN_SINUSOID,  /* as under sinusoid */
+    TWEEN_QUADRATIC, /* as under exponent 2 */
+    TWEEN_CUBIC      /* as under exponent 3 */
+} AnimationEasing;
+
+AnimationTweenPool* animation_tween_pool_new();
+int                 animation_tween_pool_add(AnimationTweenPool*, float* target, float start, float end, float duration, float start_time, AnimationEasing easing); /* add a tween, returning its index */
+void                animation_tween_pool_remove(AnimationTweenPool*, int tween);   /* remove a tween that has not finished.  its index may be reused by a later add */
+gboolean            animation_tween_pool_update(AnimationTweenPool*, float time);  /* update every tween to time.  returns TRUE if any remain. */
+int                 animation_tween_pool_size(AnimationTweenPool*);                /* the number of tweens that remain */
+void                animation_tween_pool_free(AnimationTweenPool*);
+
+
 /* Derived Values
  *
  * Derived values are attached to animations and are automatically updated as the animation progresses.
+ * A derived value attached to an animation whose values do not depend on time is only updated when the animation writes them.
+ *
+ * The values attached together are computed in dependency order: a value whose input is another's output is computed after it.
+ * A value is only recomputed when its input has changed since it was last computed, except for those made by derive,
+ * which are recomputed on every update.
  */
 
 struct DerivedValueStruct;
@@ -110,6 +346,11 @@ typedef int   (*TransformFI)(float);
 typedef float (*TransformIF)(int);
 typedef int   (*TransformII)(int);
 
+typedef void  (*TransformFFV)(const float* in, float* out, int n); /* transform n values at once */
+typedef void  (*TransformFIV)(const float* in, int*   out, int n);
+typedef void  (*TransformIFV)(const int*   in, float* out, int n);
+typedef void  (*TransformIIV)(const int*   in, int*   out, int n);
+
 DerivedValue* derive(TransformN f, int n, void* in, void* out);
 DerivedValue* deriveff(TransformFF f, float* in, float* out);
 DerivedValue* derivefi(TransformFI f, float* in, int*   out);
@@ -119,8 +360,23 @@ DerivedValue* mapderiveff(TransformFF f, int n, float* in, float* out);
 DerivedValue* mapderivefi(TransformFI f, int n, float* in, int* out);
 DerivedValue* mapderiveif(TransformIF f, int n, int* in,   float* out);
 DerivedValue* mapderiveii(TransformII f, int n, int* in,   int* out);
-
-Animation* attach(Animation*, DerivedValue*);       /* attach a derived value to an animation */
-Animation* attachn(Animation*, DerivedValue*, ...); /* attach a null-terminated list of derived values to an animation */
+DerivedValue* mapderiveffv(TransformFFV f, int n, float* in, float* out);
+DerivedValue* mapderivefiv(TransformFIV f, int n, float* in, int* out);
+DerivedValue* mapderiveifv(TransformIFV f, int n, int* in,   float* out);
+DerivedValue* mapderiveiiv(TransformIIV f, int n, int* in,   int* out);
+
+/* vectorized transforms for mapderive*v.  sin and cos are within 1e-7 for |x| < 8192 and as accurate as the C library beyond */
+void transformv_sin(const float* in, float* out, int n);
+void transformv_cos(const float* in, float* out, int n);
+void transformv_round(const float* in, float* out, int n); /* halfway cases round away from zero */
+void transformv_ftoi(const float* in, int* out, int n);    /* truncate, as a cast does, saturating outside the range of int.  NaN gives 0 */
+void transformv_itof(const int* in, float* out, int n);
+
+DerivedValue* mapderive_clamp(int n, float* in, float* out, float lo, float hi);          /* out[i] = in[i] clamped to [lo, hi] */
+DerivedValue* mapderive_affine(int n, float* in, float* out, float scale, float offset); /* out[i] = in[i] * scale + offset */
+
+Animation* attach(Animation*, DerivedValue*);              /* attach a derived value to an animation */
+Animation* attachn(Animation*, DerivedValue*, ...);        /* attach a null-terminated list of derived values to an animation */
+Animation* attachv(Animation*, DerivedValue** dvs, int n); /* attach an array of n derived values to an animation */
 
 #endif
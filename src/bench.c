@@ -0,0 +1,183 @@
+#include "anim.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Times animation_update over trees of a few shapes and sizes.  Each case prints one tab-separated line:
+ *   case, size, nodes, ns per update, nodes per second
+ * where an update is one frame of the case (one animation_update, or one update of every runner) and nodes counts the
+ * nodes, derived values and runners' nodes a frame touches, averaged over the frames where that varies.  Pass a string
+ * to run only the cases whose names contain it.
+ */
+
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_BATCH 1024
+
+typedef void (*BenchFrame)(void* data, int i);
+
+/* the time a frame takes, in ns, over enough frames to take BENCH_MIN_SECONDS */
+double bench_time(BenchFrame frame, void* data) {
+    long frames = 0;
+    gint64 start = g_get_monotonic_time(), elapsed;
+    int i;
+
+    do {
+        for (i=0; i<BENCH_BATCH; i++)
+            frame(data, i);
+        frames += BENCH_BATCH;
+        elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < BENCH_MIN_SECONDS * G_USEC_PER_SEC);
+
+    return elapsed * 1000.0 / frames;
+}
+
+void bench_report(const char* name, int size, double nodes, double ns) {
+    printf("%s\t%d\t%.1f\t%.1f\t%.0f\n", name, size, nodes, ns, nodes * 1e9 / ns);
+    fflush(stdout);
+}
+
+/* animations are updated at times sweeping through their duration */
+void animation_frame(void* data, int i) {
+    Animation* a = data;
+    animation_update(a, (float)(i % BENCH_BATCH) / (BENCH_BATCH - 1) * animation_duration(a));
+}
+
+void bench_animation(const char* filter, const char* name, int size, double nodes, Animation* a) {
+    if (strstr(name, filter) != NULL)
+        bench_report(name, size, nodes, bench_time(animation_frame, a));
+    animation_free(a);
+}
+
+/* sequencen nested depth deep */
+Animation* deep_sequence(float* v, int depth) {
+    Animation* a = linearf1(v, 0, 1);
+    int i;
+    for (i=0; i<depth; i++)
+        a = sequencen(linearf1(v, i, i+1), a, NULL);
+    return a;
+}
+
+/* the nodes an update of deep_sequence visits on average, as it only walks the sequences down to the active leaf.  the
+ * k'th of the depth+1 unit intervals of its duration is under k+1 sequences, but for the last, under all depth of them */
+double deep_sequence_nodes(int depth) {
+    double total = depth + 1;
+    int k;
+    for (k=0; k<depth; k++)
+        total += k + 2;
+    return total / (depth + 1);
+}
+
+/* paralleln width wide, each child writing its own value */
+Animation* wide_parallel(float* v, int width) {
+    Animation* a = linearf1(v, 0, 1);
+    int i;
+    for (i=1; i<width; i++)
+        a = paralleln(a, linearf1(v + i, i, 0), NULL);
+    return a;
+}
+
+/* a curve through a 3-dimensional point with degree+1 control points */
+Animation* bezier(float* v, int degree) {
+    float** points = malloc(sizeof(float*) * (degree+1));
+    int i, k;
+    for (i=0; i<=degree; i++) {
+        points[i] = malloc(sizeof(float) * 3);
+        for (k=0; k<3; k++)
+            points[i][k] = sin(i + k);
+    }
+    return bezierf(v, 3, degree+1, points);
+}
+
+/* depth time transforms, one over another */
+Animation* transform_stack(float* v, int depth) {
+    Animation* a = linearf1(v, 0, 1);
+    int i;
+    for (i=0; i<depth; i++) {
+        switch (i % 3) {
+        case 0:  a = sinusoid(a); break;
+        case 1:  a = exponent(a, 1.5); break;
+        default: a = reverse(a); break;
+        }
+    }
+    return a;
+}
+
+/* n derived values, each computed from the one before */
+Animation* derived_chain(float* v, int n) {
+    DerivedValue** dvs = malloc(sizeof(DerivedValue*) * n);
+    int i;
+    for (i=0; i<n; i++)
+        dvs[i] = mapderive_affine(1, v + i, v + i + 1, 0.5, 1.0);
+
+    /* attachn with n arguments */
+    Animation* a = attachv(linearf1(v, 0, 1), dvs, n);
+    free(dvs);
+    return a;
+}
+
+/* runners on one fixed clock, each running a 3-node animation long enough to outlast the benchmark */
+
+typedef struct RunnersStruct {
+    AnimationClock* clock;
+    int n;
+    AnimationRunner** runners;
+} Runners;
+
+void runners_frame(void* data, int i) {
+    Runners* rs = data;
+    int j;
+    animation_clock_tick(rs->clock);
+    for (j=0; j<rs->n; j++)
+        animation_runner_update(rs->runners[j]);
+}
+
+void bench_runners(const char* filter, const char* name, int n) {
+    Runners rs;
+    float* v = calloc(n, sizeof(float));
+    int j;
+
+    rs.clock   = animation_clock_fixed(1e-3);
+    rs.n       = n;
+    rs.runners = malloc(sizeof(AnimationRunner*) * n);
+    for (j=0; j<n; j++) {
+        rs.runners[j] = animation_runner_with_clock(scale(sinusoid(linearf1(v + j, 0, 1)), 1e6), rs.clock);
+        animation_runner_start(rs.runners[j]);
+    }
+
+    if (strstr(name, filter) != NULL)
+        bench_report(name, n, 3 * n, bench_time(runners_frame, &rs));
+
+    for (j=0; j<n; j++)
+        animation_runner_free(rs.runners[j]);
+    free(rs.runners);
+    animation_clock_free(rs.clock);
+    free(v);
+}
+
+int main(int argc, char** argv) {
+    const char* filter = (argc > 1) ? argv[1] : "";
+    int sizes[] = { 16, 256 }, degrees[] = { 1, 3, 7, 15 }, depths[] = { 4, 16 }, runners[] = { 64, 1024 };
+    float* v = calloc(1024, sizeof(float));
+    int i;
+
+    printf("# case\tsize\tnodes\tns/update\tnodes/sec\n");
+
+    for (i=0; i<2; i++)
+        bench_animation(filter, "sequence_deep", sizes[i], deep_sequence_nodes(sizes[i]), deep_sequence(v, sizes[i]));
+    for (i=0; i<2; i++)
+        bench_animation(filter, "parallel_wide", sizes[i], 2 * sizes[i] - 1, wide_parallel(v, sizes[i]));
+    for (i=0; i<4; i++)
+        bench_animation(filter, "bezier_degree", degrees[i], 1, bezier(v, degrees[i]));
+    for (i=0; i<2; i++)
+        bench_animation(filter, "transform_stack", depths[i], depths[i] + 1, transform_stack(v, depths[i]));
+    for (i=0; i<2; i++)
+        bench_animation(filter, "attach_derived", sizes[i], sizes[i] + 2, derived_chain(v, sizes[i]));
+    for (i=0; i<2; i++)
+        bench_runners(filter, "runners", runners[i]);
+
+    free(v);
+    return 0;
+}
@@ -1,8 +1,12 @@
+#define _POSIX_C_SOURCE 200112L /* posix_memalign */
+
 #include "anim.h" 
 
 #include <glib.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 void assert_float_equal(float f1, float f2) {
 	g_assert_cmpfloat(fabs(f1-f2), <, FLT_MIN);
@@ -56,6 +60,71 @@ void test_linearf_three_dimensions_range() {
     animation_update(a, 1.0); assert_float_equal(f[0], 20.0); assert_float_equal(f[1], 21.0); assert_float_equal(f[2], 22.0);
 }
 
+void* aligned_malloc(size_t size) {
+    void* p = NULL;
+    g_assert_cmpint(posix_memalign(&p, 32, size), ==, 0);
+    return p;
+}
+
+void test_linearf_wide() {
+    int i, n = 1003;
+    float t, *v = malloc(sizeof(float) * n), *start = malloc(sizeof(float) * n), *end = malloc(sizeof(float) * n);
+    float *va = aligned_malloc(sizeof(float) * n), *starta = aligned_malloc(sizeof(float) * n), *enda = aligned_malloc(sizeof(float) * n);
+
+    for (i=0; i<n; i++) {
+        starta[i] = start[i] = i * 0.37 - 100.0;
+        enda[i]   = end[i]   = 1000.0 / (i + 1);
+    }
+
+    Animation* a = linearf(v, n, start, end);
+    Animation* b = linearfa(va, n, starta, enda);
+
+    for (t=0.0; t<=1.0; t+=0.0625) {
+        animation_update(a, t);
+        animation_update(b, t);
+        for (i=0; i<n; i++) {
+            float expected = start[i] + (end[i] - start[i]) * t;
+            assert_float_equal(v[i], expected);
+            assert_float_equal(va[i], expected);
+        }
+    }
+
+    animation_free(a);
+    animation_free(b);
+    free(v);
+    free(va);
+}
+
+void test_lineari_wide() {
+    int i, n = 1003;
+    float t;
+    int *v = malloc(sizeof(int) * n), *start = malloc(sizeof(int) * n), *end = malloc(sizeof(int) * n);
+    int *va = aligned_malloc(sizeof(int) * n), *starta = aligned_malloc(sizeof(int) * n), *enda = aligned_malloc(sizeof(int) * n);
+
+    for (i=0; i<n; i++) {
+        starta[i] = start[i] = (i * 7919) % 20011 - 10000;
+        enda[i]   = end[i]   = (i % 3 == 0) ? -start[i] : i * 40009;
+    }
+
+    Animation* a = lineari(v, n, start, end);
+    Animation* b = linearia(va, n, starta, enda);
+
+    for (t=0.0; t<=1.0; t+=0.0625) {
+        animation_update(a, t);
+        animation_update(b, t);
+        for (i=0; i<n; i++) {
+            int expected = start[i] + (end[i] - start[i]) * t;
+            g_assert_cmpint(v[i], ==, expected);
+            g_assert_cmpint(va[i], ==, expected);
+        }
+    }
+
+    animation_free(a);
+    animation_free(b);
+    free(v);
+    free(va);
+}
+
 void test_sequence() {
     float f=0.0, start1 = 0.0, end1 = 1.0, start2 = 1.0, end2 = 0.0;
     Animation* a = sequence(linearf(&f, 1, &start1, &end1), linearf(&f, 1, &start2, &end2));
@@ -68,6 +137,65 @@ void test_sequence() {
     animation_update(a, 2.0); assert_float_equal(f, 0.0);
 }
 
+void test_sequencen() {
+    float f=0.0;
+    Animation* a = sequencen(linearf1(&f, 0, 1), scale(linearf1(&f, 1, 0), 2), linearf1(&f, 5, 6), NULL);
+    assert_float_equal(animation_duration(a), 4.0);
+
+    animation_update(a, 0.0); assert_float_equal(f, 0.0);
+    animation_update(a, 1.0); assert_float_equal(f, 1.0);
+    animation_update(a, 2.0); assert_float_equal(f, 0.5);
+    animation_update(a, 3.0); assert_float_equal(f, 0.0);
+    animation_update(a, 3.5); assert_float_equal(f, 5.5);
+    animation_update(a, 4.0); assert_float_equal(f, 6.0);
+
+    animation_free(a);
+}
+
+void test_sequencev() {
+    int i, n = 5000;
+    float f=0.0;
+    Animation** as = malloc(sizeof(Animation*) * n);
+    for (i=0; i<n; i++)
+        as[i] = linearf1(&f, i, i+1);
+
+    Animation* a = sequencev(as, n);
+    free(as);
+    assert_float_equal(animation_duration(a), n);
+
+    animation_update(a, 0.0);   assert_float_equal(f, 0.0);
+    animation_update(a, 17.5);  assert_float_equal(f, 17.5);
+    animation_update(a, 4999.5); assert_float_equal(f, 4999.5);
+    animation_update(a, n);     assert_float_equal(f, n);
+
+    animation_free(a);
+}
+
+void test_sequence_cursor() {
+    int i, n = 100;
+    float f=0.0, t;
+    Animation** as = malloc(sizeof(Animation*) * n);
+    for (i=0; i<n; i++)
+        as[i] = scale(linearf1(&f, i, i+1), 0.5);
+
+    Animation* a = sequencev(as, n);
+    free(as);
+
+    /* forward playback, backward playback and jumps must all agree with a fresh lookup */
+    for (t=0.0; t<=50.0; t+=0.25) {
+        animation_update(a, t); assert_float_equal(f, t*2);
+    }
+    for (t=50.0; t>=0.0; t-=0.75) {
+        animation_update(a, t); assert_float_equal(f, t*2);
+    }
+    animation_update(a, 40.0); assert_float_equal(f, 80.0);
+    animation_update(a, 0.5);  assert_float_equal(f, 1.0);
+    animation_update(a, 0.0);  assert_float_equal(f, 0.0);
+    animation_update(a, 49.5); assert_float_equal(f, 99.0);
+
+    animation_free(a);
+}
+
 void test_parallel() {
     float f1=0.0, f2=0.0, start1 = 0.0, end1 = 1.0, start2 = 1.0, end2 = 0.0;
     Animation* a = parallel(linearf(&f1, 1, &start1, &end1), linearf(&f2, 1, &start2, &end2));
@@ -156,6 +284,432 @@ void test_delay() {
     animation_update(a, 2.0); assert_float_equal(f, 1.0);
 }
 
+void test_duration_cached() {
+    float x=0.0, y=0.0;
+    Animation* a = sequence(parallel(scale(linearf1(&x, 0, 1), 2), delay(linearf1(&y, 0, 1), 1)),
+                            pad_by(sinusoid(scale(linearf1(&x, 1, 0), 3)), 1));
+    assert_float_equal(animation_duration(a), 6.0);
+
+    animation_invalidate(a);
+    assert_float_equal(animation_duration(a), 6.0);
+
+    animation_update(a, 1.0); assert_float_equal(x, 0.5); assert_float_equal(y, 0.0);
+    animation_update(a, 2.0); assert_float_equal(x, 1.0); assert_float_equal(y, 1.0);
+    animation_update(a, 5.0); assert_float_equal(x, 0.0); assert_float_equal(y, 1.0);
+
+    animation_free(a);
+}
+
+float twice(float f) {
+    return 2.0 * f;
+}
+
+Animation* compile_scenario(float* x, float* y, int* i, float* z) {
+    return parallel(sequencen(scale(linearf1(x, 0, 3), 3),
+                              sinusoid(linearf1(x, 1, 3)),
+                              sequence(delay(exponent(scale(linearf1(x, 3, 0), 2), 2.0), 1), reverse(lineari1(i, 0, 10))),
+                              NULL),
+                    attach(pad_to(scale(linearf1(y, 1, 5), 4), 8), deriveff(twice, y, z)));
+}
+
+void test_compile() {
+    float x1=0.0, y1=0.0, z1=0.0, x2=0.0, y2=0.0, z2=0.0, t;
+    int i1=0, i2=0;
+    Animation* a = compile_scenario(&x1, &y1, &i1, &z1);
+    Animation* c = animation_compile(compile_scenario(&x2, &y2, &i2, &z2));
+    assert_float_equal(animation_duration(c), animation_duration(a));
+
+    for (t=0.0; t<=8.0; t+=0.125) {
+        animation_update(a, t);
+        animation_update(c, t);
+        g_assert_cmpfloat(fabs(x1-x2), <, 1e-5);
+        g_assert_cmpfloat(fabs(y1-y2), <, 1e-5);
+        g_assert_cmpfloat(fabs(z1-z2), <, 1e-5);
+        g_assert_cmpint(i1, ==, i2);
+    }
+
+    animation_free(a);
+    animation_free(c);
+}
+
+Animation* optimize_scenario(float* x, float* y, float* z) {
+    return parallelp(sequencen(scale(scale(linearf1(x, 0, 1), 2), 3),
+                               reverse(reverse(identity(linearf1(x, 1, 2)))),
+                               delay(delay(sinusoid(scale(sinusoid(linearf1(x, 2, 0)), 2)), 1), 0.5),
+                               sequence(pad_by(exponent(exponent(linearf1(y, 0, 1), 2), 1.5), 1), reverse(scale(reverse(linearf1(y, 1, 0)), 3))),
+                               NULL),
+                     attach(delay(linearf1(z, 0, 1), 4), deriveff(twice, z, y)));
+}
+
+void test_optimize() {
+    float x1=0.0, y1=0.0, z1=0.0, x2=0.0, y2=0.0, z2=0.0, t;
+    Animation* a = optimize_scenario(&x1, &y1, &z1);
+    Animation* o = animation_optimize(optimize_scenario(&x2, &y2, &z2));
+    g_assert_cmpfloat(fabs(animation_duration(o) - animation_duration(a)), <, 1e-5);
+
+    for (t=0.0; t<=animation_duration(a); t+=0.0625) {
+        animation_update(a, t);
+        animation_update(o, t);
+        g_assert_cmpfloat(fabs(x1-x2), <, 1e-5);
+        g_assert_cmpfloat(fabs(y1-y2), <, 1e-5);
+        g_assert_cmpfloat(fabs(z1-z2), <, 1e-5);
+    }
+
+    animation_free(a);
+    animation_free(o);
+
+    /* what cancels out entirely leaves the animation itself */
+    Animation* l = linearf1(&x1, 0, 1);
+    g_assert(animation_optimize(scale(reverse(identity(scale(reverse(l), 0.5))), 2)) == l);
+    animation_free(l);
+
+    /* derived values write their outputs, so a null animation carrying them is kept, in parallels and sequences alike */
+    o = animation_optimize(parallel(linearf1(&x1, 0, 1), attach(null_animation(), deriveff(twice, &x1, &y1))));
+    animation_update(o, 0.5); assert_float_equal(x1, 0.5); assert_float_equal(y1, 1.0);
+    animation_free(o);
+
+    o = animation_optimize(sequencen(linearf1(&x1, 0, 1), attach(null_animation(), deriveff(twice, &x1, &y1)), null_animation(), NULL));
+    g_assert_cmpfloat(animation_duration(o), ==, 3.0);
+    animation_update(o, 1.0); animation_update(o, 1.5); assert_float_equal(y1, 2.0);
+    animation_free(o);
+}
+
+Animation* batch_scenario(float* x, float* p) {
+    float *start = malloc(sizeof(float) * 3), *end = malloc(sizeof(float) * 3);
+    start[0] = 0.0; start[1] = 1.0; start[2] = 2.0;
+    end[0]   = 3.0; end[1]   = 2.0; end[2]   = 1.0;
+
+    return parallel(sequencen(scale(linearf1(x, 0, 3), 3), sinusoid(linearf1(x, 1, 3)), pad_by(reverse(linearf1(x, 3, 0)), 2), NULL),
+                    sequence(delay(scale(linearf(p, 3, start, end), 2), 3), scale(linearf1(&p[1], 5, 6), 2)));
+}
+
+void check_batch(Animation* a, Animation* b, float* x, float* p, float* bx, float* bp) {
+    float times[] = { 0.0, 0.5, 1.0, 6.5, 7.0, 2.25, 3.0, 3.5, 4.0, 5.5, 7.0, 4.5, 6.0 };
+    int i, j, n = sizeof(times) / sizeof(float), sizes[] = { 1, 3 };
+    float* outputs[2];
+    float* buffer = malloc(sizeof(float) * n * 5);
+
+    outputs[0] = bx;
+    outputs[1] = bp;
+    animation_sample_batch(b, times, n, outputs, sizes, 2, buffer, 5);
+
+    for (i=0; i<n; i++) {
+        animation_update(a, times[i]);
+        assert_float_equal(buffer[i*5], *x);
+        for (j=0; j<3; j++)
+            assert_float_equal(buffer[i*5 + 1 + j], p[j]);
+    }
+
+    assert_float_equal(*bx, *x);
+    for (j=0; j<3; j++)
+        assert_float_equal(bp[j], p[j]);
+
+    free(buffer);
+}
+
+void test_sample_batch() {
+    float x=0.0, p[3] = { 0.0, 0.0, 0.0 }, bx=0.0, bp[3] = { 0.0, 0.0, 0.0 };
+    Animation* a = batch_scenario(&x, p);
+    Animation* b = batch_scenario(&bx, bp);
+    check_batch(a, b, &x, p, &bx, bp);
+    animation_free(a);
+    animation_free(b);
+}
+
+/* a point that only partly lies in an output, or spans two, has the values that do lie in one written */
+void test_sample_batch_partial() {
+    float p[4] = { 9.0, 0.0, 0.0, 0.0 };
+    float times[] = { 0.0, 0.5, 1.0 }, buffer[3*3];
+    float* start = malloc(sizeof(float) * 3);
+    float* end = malloc(sizeof(float) * 3);
+    float* outputs[2];
+    int i, sizes[] = { 2, 1 };
+
+    start[0] = 1.0; start[1] = 2.0; start[2] = 3.0;
+    end[0]   = 5.0; end[1]   = 6.0; end[2]   = 7.0;
+    Animation* a = linearf(p + 1, 3, start, end);
+
+    /* p[0] and p[1], then p[2], leaving out p[3] */
+    outputs[0] = p;
+    outputs[1] = p + 2;
+    animation_sample_batch(a, times, 3, outputs, sizes, 2, buffer, 3);
+
+    for (i=0; i<3; i++) {
+        assert_float_equal(buffer[i*3], 9.0);
+        assert_float_equal(buffer[i*3 + 1], 1.0 + 4.0 * times[i]);
+        assert_float_equal(buffer[i*3 + 2], 2.0 + 4.0 * times[i]);
+    }
+
+    animation_free(a);
+}
+
+void test_sample_batch_derived() {
+    float x=0.0, p[3] = { 0.0, 0.0, 0.0 }, bx=0.0, bp[3] = { 0.0, 0.0, 0.0 }, z=0.0, bz=0.0;
+    Animation* a = attach(batch_scenario(&x, p), deriveff(twice, &x, &z));
+    Animation* b = attach(batch_scenario(&bx, bp), deriveff(twice, &bx, &bz));
+    check_batch(a, b, &x, p, &bx, bp);
+    animation_free(a);
+    animation_free(b);
+}
+
+void test_bake() {
+    float x=0.0, p[3] = { 0.0, 0.0, 0.0 }, z=0.0;
+    float* outputs[3];
+    int sizes[] = { 1, 3, 1 };
+    Animation* a = attach(batch_scenario(&x, p), deriveff(twice, &x, &z));
+
+    outputs[0] = &x;
+    outputs[1] = p;
+    outputs[2] = &z;
+    Animation* b = animation_bake(a, 10.0, outputs, sizes, 3);
+    assert_float_equal(animation_duration(b), 7.0);
+
+    animation_update(b, 0.0); assert_float_equal(x, 0.0); assert_float_equal(z, 0.0);
+    animation_update(b, 1.5); assert_float_equal(x, 1.5); assert_float_equal(z, 3.0);
+    animation_update(b, 2.25); assert_float_equal(x, 2.25); assert_float_equal(z, 4.5);
+    animation_update(b, 7.0); assert_float_equal(x, 3.0); assert_float_equal(p[1], 6.0);
+
+    animation_free(a);
+    animation_free(b);
+}
+
+void test_bake_error() {
+    float x=0.0, z=0.0;
+    float* outputs[2];
+    int sizes[] = { 1, 1 };
+    Animation* a = attach(sinusoid(scale(linearf1(&x, 0, 4), 4)), deriveff(twice, &x, &z));
+
+    outputs[0] = &x;
+    outputs[1] = &z;
+    Animation* coarse = animation_bake(a, 2.0, outputs, sizes, 2);
+    Animation* fine   = animation_bake(a, 50.0, outputs, sizes, 2);
+
+    g_assert_cmpfloat(animation_bake_error(fine, a), >, 0.0);
+    g_assert_cmpfloat(animation_bake_error(fine, a), <, 0.001);
+    g_assert_cmpfloat(animation_bake_error(coarse, a), >, animation_bake_error(fine, a));
+
+    animation_free(a);
+    animation_free(coarse);
+    animation_free(fine);
+}
+
+Animation* instance_scenario(float* x, float* p) {
+    float *start = malloc(sizeof(float) * 3), *end = malloc(sizeof(float) * 3);
+    start[0] = 0.0; start[1] = 1.0; start[2] = 2.0;
+    end[0]   = 3.0; end[1]   = 2.0; end[2]   = 1.0;
+
+    return parallel(sequence(scale(linearf1(x, 0, 3), 3), sinusoid(scale(linearf1(x, 3, 1), 2))), scale(linearf(p, 3, start, end), 5));
+}
+
+void test_instances() {
+    float x=0.0, p[3] = { 0.0, 0.0, 0.0 }, ex=0.0, ep[3] = { 0.0, 0.0, 0.0 };
+    float xs[5], ps[5][3];
+    float* outputs[2];
+    float* targets[2];
+    float offsets[] = { 0.0, 0.5, 1.0, 0.5, 0.0 }, rates[] = { 1.0, 1.0, 0.5, 1.0, 2.0 }, times[] = { 3.0, 7.0 };
+    int i, k, sizes[] = { 1, 3 };
+
+    outputs[0] = &x;
+    outputs[1] = p;
+    AnimationInstances* is = animation_instances_new(instance_scenario(&x, p), outputs, sizes, 2);
+    Animation* expected = instance_scenario(&ex, ep);
+
+    /* instances 1 and 3 sample the same times, and instance 2 is replaced */
+    for (i=0; i<5; i++) {
+        targets[0] = &xs[i];
+        targets[1] = ps[i];
+        g_assert_cmpint(animation_instances_add(is, targets, (i == 2) ? 9.0 : offsets[i], rates[i]), ==, i);
+    }
+
+    animation_instances_remove(is, 2);
+    targets[0] = &xs[2];
+    targets[1] = ps[2];
+    g_assert_cmpint(animation_instances_add(is, targets, offsets[2], rates[2]), ==, 2);
+
+    for (k=0; k<2; k++) {
+        g_assert(animation_instances_update(is, times[k]));
+        for (i=0; i<5; i++) {
+            float t = (times[k] - offsets[i]) * rates[i];
+            animation_update(expected, (t < 5.0) ? t : 5.0);
+            assert_float_equal(xs[i], ex);
+            assert_float_equal(ps[i][0], ep[0]); assert_float_equal(ps[i][1], ep[1]); assert_float_equal(ps[i][2], ep[2]);
+        }
+    }
+
+    g_assert(!animation_instances_update(is, 16.0));
+
+    animation_instances_free(is);
+    animation_free(expected);
+}
+
+Animation* image_scenario(float* x, float* p, int* i) {
+    float *start = malloc(sizeof(float) * 2), *end = malloc(sizeof(float) * 2);
+    float** points = malloc(sizeof(float*) * 3);
+    int k;
+
+    start[0] = 0.0; start[1] = 1.0;
+    end[0]   = 3.0; end[1]   = 9.5;
+    for (k=0; k<3; k++) {
+        points[k] = malloc(sizeof(float));
+        points[k][0] = (k == 1) ? 4.0 : 1.0;
+    }
+
+    return parallel(sequencen(scale(linearf1(x, 0, 3), 3),
+                              sinusoid(transform(scale(bezierf(x, 1, 3, points), 2), cubic_bezier_transform(0.25, 0.1, 0.25, 1.0))),
+                              reverse(exponent(linearf1(x, 1, 0), 2.5)),
+                              NULL),
+                    attachn(scale(linearf(p, 2, start, end), 6), mapderive_affine(1, p, p + 2, 2.0, 1.0), mapderivefiv(transformv_ftoi, 1, p + 1, i), NULL));
+}
+
+/* a new temporary file, for the caller to remove and free */
+gchar* image_path() {
+    gchar* path;
+    gint fd = g_file_open_tmp("libanim-XXXXXX", &path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    g_close(fd, NULL);
+    return path;
+}
+
+void test_image() {
+    float x1=0.0, x2=0.0, p1[3] = { 0.0, 0.0, 0.0 }, p2[3] = { 0.0, 0.0, 0.0 }, t;
+    int i1=0, i2=0;
+    const char* names[] = { "x", "p", "i" };
+    int sizes[] = { sizeof(float), sizeof(float) * 3, sizeof(int) };
+    void* outputs[3];
+    gchar* path = image_path();
+
+    /* the optimizer chains the sinusoid and cubic bezier transforms */
+    Animation* a = animation_optimize(image_scenario(&x1, p1, &i1));
+    outputs[0] = &x1; outputs[1] = p1; outputs[2] = &i1;
+    g_assert(animation_save(a, path, names, outputs, sizes, 3));
+
+    outputs[0] = &x2; outputs[1] = p2; outputs[2] = &i2;
+    Animation* l = animation_load(path, names, outputs, sizes, 3);
+    g_assert(l != NULL);
+    assert_float_equal(animation_duration(l), animation_duration(a));
+
+    for (t=0.0; t<=6.0; t+=0.0625) {
+        animation_update(a, t);
+        animation_update(l, t);
+        g_assert_cmpfloat(fabs(x1-x2), <, 1e-5);
+        g_assert_cmpfloat(fabs(p1[0]-p2[0]), <, 1e-5);
+        g_assert_cmpfloat(fabs(p1[1]-p2[1]), <, 1e-5);
+        g_assert_cmpfloat(fabs(p1[2]-p2[2]), <, 1e-5);
+        g_assert_cmpint(i1, ==, i2);
+    }
+
+    /* every output the image names must be bound */
+    g_assert(animation_load(path, names, outputs, sizes, 2) == NULL);
+
+    animation_free(l);
+    animation_free(a);
+
+    /* derived values are written while their child is padding */
+    a = sequence(linearf1(&x1, 0, 1), attach(pad_by(null_animation(), 1), mapderive_affine(1, &x1, p1, 2.0, 1.0)));
+    outputs[0] = &x1; outputs[1] = p1;
+    g_assert(animation_save(a, path, names, outputs, sizes, 2));
+    animation_free(a);
+
+    l = animation_load(path, names, outputs, sizes, 2);
+    g_assert(l != NULL);
+    x1 = 0.5; p1[0] = 0.0;
+    animation_update(l, 1.5); assert_float_equal(x1, 0.5); assert_float_equal(p1[0], 2.0);
+    animation_update(l, 2.0); assert_float_equal(p1[0], 2.0);
+    animation_free(l);
+
+    /* derived values computed by arbitrary functions cannot be saved */
+    a = attach(linearf1(&x1, 0, 1), deriveff(twice, &x1, p1));
+    g_assert(!animation_save(a, path, names, outputs, sizes, 2));
+    animation_free(a);
+
+    remove(path);
+    g_free(path);
+}
+
+/* an image damaged in any one word either fails to load or plays without reaching outside itself and its outputs */
+void test_image_corrupt() {
+    float x=0.0, p[3] = { 0.0, 0.0, 0.0 };
+    int i=0, d, k, rejected = 0;
+    const char* names[] = { "x", "p", "i" };
+    int sizes[] = { sizeof(float), sizeof(float) * 3, sizeof(int) };
+    void* outputs[3];
+    gchar *path = image_path(), *image;
+    gsize size, w;
+
+    outputs[0] = &x; outputs[1] = p; outputs[2] = &i;
+    Animation* a = animation_optimize(image_scenario(&x, p, &i));
+    g_assert(animation_save(a, path, names, outputs, sizes, 3));
+    animation_free(a);
+    g_assert(g_file_get_contents(path, &image, &size, NULL));
+
+    g_assert(g_file_set_contents(path, image, size - 4, NULL));
+    g_assert(animation_load(path, names, outputs, sizes, 3) == NULL);
+
+    /* one more than each word moves indices onto their parents and offsets off their alignment, a flipped sign bit
+     * takes indices and offsets far out of range, and all bits set makes floats not numbers */
+    for (w=0; w+4<=size; w+=4) {
+        for (d=0; d<3; d++) {
+            guint32 word, damaged;
+            memcpy(&word, image + w, 4);
+            damaged = (d == 0) ? word + 1 : (d == 1) ? word ^ 0x80000000 : 0xffffffff;
+            memcpy(image + w, &damaged, 4);
+            g_assert(g_file_set_contents(path, image, size, NULL));
+            memcpy(image + w, &word, 4);
+
+            Animation* l = animation_load(path, names, outputs, sizes, 3);
+            if (l == NULL) {
+                rejected++;
+                continue;
+            }
+
+            for (k=0; k<=8; k++)
+                animation_update(l, (k * 0.75 < animation_duration(l)) ? k * 0.75 : animation_duration(l));
+            animation_free(l);
+        }
+    }
+    g_assert_cmpint(rejected, >, 0);
+
+    remove(path);
+    g_free(path);
+    g_free(image);
+}
+
+void test_stats() {
+    float x=0.0, y=0.0, t;
+    AnimationNodeProfile nodes[16];
+    Animation* a = parallel(sequence(delay(linearf1(&x, 0, 1), 1), scale(linearf1(&x, 1, 0), 2)), pad_to(linearf1(&y, 0, 1), 4));
+
+    AnimationStats stats = animation_stats(a);
+    g_assert_cmpint(stats.nodes, ==, 12);
+    g_assert_cmpint(stats.max_depth, ==, 5);
+    g_assert_cmpint(stats.null_nodes, ==, 2);
+    g_assert_cmpint(stats.pad_nodes, ==, 2);
+    g_assert_cmpint(stats.bytes, >, 0);
+
+    for (t=0.0; t<=4.0; t+=0.5)
+        animation_update(a, t);
+
+    g_assert_cmpint(animation_profile(a, nodes, 16), ==, 12);
+    g_assert_cmpstr(nodes[0].kind, ==, "parallel");
+    g_assert_cmpint(nodes[0].depth, ==, 1);
+    g_assert_cmpstr(nodes[4].kind, ==, "null");
+    g_assert_cmpint(nodes[4].depth, ==, 5);
+    g_assert_cmpint(nodes[0].calls, ==, animation_profiling() ? 9 : 0);
+
+    animation_profile_reset(a);
+    animation_profile(a, nodes, 1);
+    g_assert_cmpint(nodes[0].calls, ==, 0);
+
+    char* text = animation_profile_text(a);
+    char* json = animation_profile_json(a);
+    g_assert(strncmp(text, "nodes 12, max depth 5", 21) == 0);
+    g_assert(strstr(json, "\"nodes\": 12") != NULL);
+    g_free(text);
+    g_free(json);
+
+    animation_free(a);
+}
+
 void scenario_one() {
 	float x=0.0, y=0.0;
 	Animation* a = parallel(sequence(scale(linearf1(&x, 0, 3), 3), reverse(linearf1(&x, 1, 3))),
@@ -236,6 +790,746 @@ void test_bezier_three_dimension_one() {
     animation_free(a);
 }
 
+void test_bezier_high_degree() {
+    int i, j, k, n = 3, m = 40;
+    float v[3], t;
+    double* w = malloc(sizeof(double) * m * n);
+    double* p = malloc(sizeof(double) * m * n);
+
+    float** c = malloc(sizeof(float*) * m);
+    for (i=0; i<m; i++) {
+        c[i] = malloc(sizeof(float) * n);
+        for (k=0; k<n; k++)
+            p[i*n + k] = c[i][k] = sin(i * 1.7 + k) * 10.0;
+    }
+
+    Animation* a = bezierf(v, n, m, c);
+
+    for (t=0.0; t<=1.0; t+=0.03125) {
+        animation_update(a, t);
+
+        /* de casteljau */
+        memcpy(w, p, sizeof(double) * m * n);
+        for (i=m-1; i>=1; i--)
+            for (j=0; j<i; j++)
+                for (k=0; k<n; k++)
+                    w[j*n + k] += (w[(j+1)*n + k] - w[j*n + k]) * t;
+
+        for (k=0; k<n; k++)
+            g_assert_cmpfloat(fabs(v[k] - w[k]), <, 1e-5);
+    }
+
+    animation_free(a);
+    free(w);
+    free(p);
+}
+
+float** spline_points(int k) {
+    int i;
+    float** p = malloc(sizeof(float*) * k);
+    for (i=0; i<k; i++) {
+        p[i] = malloc(sizeof(float) * 2);
+        p[i][0] = i;
+        p[i][1] = sin(i * 0.37) * 5.0;
+    }
+    return p;
+}
+
+void check_spline_knots(Animation* a, float* v, int k) {
+    int i;
+    for (i=0; i<k; i++) {
+        animation_update(a, (float)i / (k-1));
+        g_assert_cmpfloat(fabs(v[0] - i), <, 1e-3);
+        g_assert_cmpfloat(fabs(v[1] - sin(i * 0.37) * 5.0), <, 1e-3);
+    }
+}
+
+void test_catmullrom() {
+    int k = 2000;
+    float v[2];
+    Animation* a = catmullromf(v, 2, k, spline_points(k));
+    check_spline_knots(a, v, k);
+    animation_free(a);
+}
+
+void test_naturalspline() {
+    int k = 2000;
+    float v[2];
+    Animation* a = naturalsplinef(v, 2, k, spline_points(k));
+    check_spline_knots(a, v, k);
+
+    /* straight lines stay straight */
+    animation_update(a, 0.3); g_assert_cmpfloat(fabs(v[0] - 0.3 * (k-1)), <, 1e-3);
+    animation_free(a);
+}
+
+void test_bspline() {
+    int k = 5;
+    float v[2], t, x=0.0;
+    Animation* a = bsplinef(v, 2, k, spline_points(k));
+
+    animation_update(a, 0.0); g_assert_cmpfloat(fabs(v[0]), <, 1e-6); g_assert_cmpfloat(fabs(v[1]), <, 1e-6);
+    animation_update(a, 1.0); g_assert_cmpfloat(fabs(v[0] - 4.0), <, 1e-5); g_assert_cmpfloat(fabs(v[1] - sin(4 * 0.37) * 5.0), <, 1e-5);
+
+    /* evenly spaced x points give an evenly advancing x */
+    for (t=0.0; t<=1.0; t+=0.0625) {
+        animation_update(a, t);
+        g_assert_cmpfloat(v[0], >=, x);
+        x = v[0];
+    }
+
+    animation_free(a);
+}
+
+void test_keyframes_modes() {
+    float v = 0.0, times[] = { 1.0, 2.0, 4.0, 5.0 }, values[] = { 0.0, 10.0, 20.0, 0.0 };
+    KeyframeMode modes[] = { KEYFRAME_STEP, KEYFRAME_LINEAR, KEYFRAME_CUBIC, KEYFRAME_STEP };
+    Animation* a = keyframesf(&v, 1, 4, times, values, modes);
+    assert_float_equal(animation_duration(a), 4.0);
+
+    animation_update(a, 0.0); assert_float_equal(v, 0.0);
+    animation_update(a, 0.5); assert_float_equal(v, 0.0);
+    animation_update(a, 1.0); assert_float_equal(v, 10.0);
+    animation_update(a, 2.0); assert_float_equal(v, 15.0);
+    animation_update(a, 3.0); assert_float_equal(v, 20.0);
+    animation_update(a, 4.0); assert_float_equal(v, 0.0);
+
+    /* the cubic segment falls smoothly from 20 to 0 */
+    float v1, v2;
+    animation_update(a, 3.25); v1 = v;
+    animation_update(a, 3.75); v2 = v;
+    g_assert_cmpfloat(v1, <, 20.0); g_assert_cmpfloat(v1, >, v2); g_assert_cmpfloat(v2, >, 0.0);
+
+    animation_free(a);
+}
+
+void test_keyframes_long() {
+    int i, n = 10000;
+    float v[2], t;
+    float* times = malloc(sizeof(float) * n);
+    float* values = malloc(sizeof(float) * n * 2);
+    for (i=0; i<n; i++) {
+        times[i] = i * 0.5;
+        values[i*2] = i;
+        values[i*2+1] = -i;
+    }
+
+    Animation* a = keyframesf(v, 2, n, times, values, NULL);
+    free(times);
+    free(values);
+
+    for (t=0.0; t<=animation_duration(a); t+=3.7) {
+        animation_update(a, t); g_assert_cmpfloat(fabs(v[0] - 2*t), <, 1e-3); g_assert_cmpfloat(fabs(v[1] + 2*t), <, 1e-3);
+    }
+    animation_update(a, 100.25); assert_float_equal(v[0], 200.5);
+    animation_update(a, 4000.0); assert_float_equal(v[1], -8000.0);
+    animation_update(a, 0.0);    assert_float_equal(v[0], 0.0);
+
+    animation_free(a);
+}
+
+void test_arena() {
+    float x, y[2];
+    int i;
+
+    float* start = malloc(sizeof(float) * 2);
+    float* end = malloc(sizeof(float) * 2);
+    start[0] = 0.0; start[1] = 10.0;
+    end[0] = 1.0;   end[1] = 0.0;
+
+    /* a small block size forces several blocks */
+    AnimationArena* arena = animation_arena_new(256);
+    animation_arena_push(arena);
+    Animation* a = parallel(sequence(linearf1(&x, 0.0, 1.0), sinusoid(linearf1(&x, 1.0, 3.0))), scale(linearf(y, 2, start, end), 2.0));
+    Animation* b = attach(linearf1(&x, 0.0, 1.0), deriveff(twice, &x, &y[0]));
+    animation_arena_pop();
+
+    for (i=0; i<3; i++) {
+        animation_update(a, 0.5); assert_float_equal(x, 0.5); assert_float_equal(y[0], 0.25); assert_float_equal(y[1], 7.5);
+        animation_update(a, 1.5); assert_float_equal(x, 2.0);
+        animation_update(a, 2.0); assert_float_equal(x, 3.0); assert_float_equal(y[0], 1.0);
+    }
+    animation_update(b, 0.5); assert_float_equal(y[0], 1.0);
+
+    animation_free(a);
+    animation_free(b);
+    animation_arena_free(arena);
+}
+
+/* the data the vector kernels stream through is 32-byte aligned in an arena as on the heap, which arena_alloc asserts */
+void test_arena_aligned() {
+    float x, y;
+    int i, k;
+
+    /* many small blocks, so that some would start off a 32-byte boundary if nothing placed them on one */
+    AnimationArena* arena = animation_arena_new(200);
+    animation_arena_push(arena);
+    for (k=0; k<64; k++) {
+        float** c = malloc(sizeof(float*) * 3);
+        for (i=0; i<3; i++) {
+            c[i] = malloc(sizeof(float));
+            c[i][0] = (i == 1) ? 2.0 : 0.0;
+        }
+
+        Animation* a = parallel(linearf1(&x, 0.0, 1.0), bezierf(&y, 1, 3, c));
+        animation_update(a, 0.5); assert_float_equal(y, 1.0);
+    }
+    animation_arena_pop();
+    animation_arena_free(arena);
+}
+
+/* a hold's one array is released once, whether by its arena or by animation_free */
+void test_arena_hold() {
+    float x, *c = malloc(sizeof(float));
+    int i, *d = malloc(sizeof(int));
+    *c = 2.5;
+    *d = 7;
+
+    AnimationArena* arena = animation_arena_new(0);
+    animation_arena_push(arena);
+    Animation* a = parallel(holdf(&x, 1, c), holdi(&i, 1, d));
+    animation_arena_pop();
+
+    animation_update(a, 1.0); assert_float_equal(x, 2.5); g_assert_cmpint(i, ==, 7);
+    animation_arena_free(arena);
+
+    c = malloc(sizeof(float));
+    d = malloc(sizeof(int));
+    *c = 1.5;
+    *d = 3;
+    a = parallel(holdf(&x, 1, c), holdi(&i, 1, d));
+    animation_update(a, 1.0); assert_float_equal(x, 1.5); g_assert_cmpint(i, ==, 3);
+    animation_free(a);
+}
+
+/* an arena pushed twice would be its own previous arena, and popping would never get past it */
+void test_arena_push_twice() {
+    AnimationArena* arena = animation_arena_new(0);
+    AnimationArena* other = animation_arena_new(0);
+
+    if (g_test_subprocess()) {
+        animation_arena_push(arena);
+        animation_arena_push(other);
+        animation_arena_push(arena);
+        return;
+    }
+    g_test_trap_subprocess(NULL, 0, 0);
+    g_test_trap_assert_failed();
+
+    animation_arena_free(arena);
+    animation_arena_free(other);
+}
+
+void test_arena_mixed() {
+    float x;
+
+    /* heap children of an arena node are freed with the arena */
+    Animation* child = linearf1(&x, 0.0, 1.0);
+
+    AnimationArena* outer = animation_arena_new(0);
+    AnimationArena* inner = animation_arena_new(0);
+    animation_arena_push(outer);
+    animation_arena_push(inner);
+    Animation* b = linearf1(&x, 5.0, 6.0);
+    animation_arena_pop();
+    Animation* a = sequence(scale(child, 2.0), b);
+    animation_arena_pop();
+
+    animation_update(a, 1.0); assert_float_equal(x, 0.5);
+    animation_update(a, 2.5); assert_float_equal(x, 5.5);
+
+    animation_arena_free(outer);
+    animation_update(b, 0.5); assert_float_equal(x, 5.5);
+    animation_arena_free(inner);
+}
+
+void test_seal() {
+    float x, y, z;
+
+    Animation* s = attach(parallel(sequencen(sinusoid(linearf1(&x, 0.0, 1.0)), scale(exponent(linearf1(&x, 1.0, 2.0), 2.0), 2.0), reverse(linearf1(&x, 3.0, 2.0)), NULL),
+                                   pad_to(linearf1(&y, 5.0, 6.0), 4.0)),
+                          deriveff(twice, &x, &z));
+    animation_seal(s);
+    animation_seal(s);
+
+    /* the ends of the sequence's children, with y padded and z derived throughout */
+    animation_update(s, 0.0); assert_float_equal(x, 0.0); assert_float_equal(y, 5.0); assert_float_equal(z, 0.0);
+    animation_update(s, 1.0); assert_float_equal(x, 1.0); assert_float_equal(y, 6.0); assert_float_equal(z, 2.0);
+    animation_update(s, 2.0); assert_float_equal(x, 1.25); assert_float_equal(y, 6.0); assert_float_equal(z, 2.5);
+    animation_update(s, 4.0); assert_float_equal(x, 3.0); assert_float_equal(y, 6.0); assert_float_equal(z, 6.0);
+
+    /* invalidating unseals, and the tree can be sealed again */
+    animation_invalidate(s);
+    animation_seal(s);
+    animation_update(s, 2.0); assert_float_equal(x, 1.25); assert_float_equal(z, 2.5);
+
+    animation_free(s);
+}
+
+/* a sealed child is checked as usual when its parent is not sealed, as the times it is given were never validated */
+void test_seal_unsealed_parent() {
+    float x;
+
+    Animation* child = linearf1(&x, 0.0, 1.0);
+    animation_seal(child);
+    Animation* a = exponent(child, 2.0);
+    animation_update(a, 0.5); assert_float_equal(x, 0.25);
+    animation_free(a);
+
+    if (g_test_subprocess()) {
+        child = linearf1(&x, 0.0, 1.0);
+        animation_seal(child);
+        animation_update(exponent(child, -1.0), 0.25);
+        return;
+    }
+    g_test_trap_subprocess(NULL, 0, 0);
+    g_test_trap_assert_failed();
+}
+
+void count_updates(int n, void* in, void* out) {
+    int* count = out;
+    *count = *count + 1;
+}
+
+void test_scheduler() {
+    int i, n = 4000, count = 0;
+    float* xs = malloc(sizeof(float) * n);
+    AnimationRunner* previous = NULL;
+
+    AnimationScheduler* s = animation_scheduler_new(4);
+    g_assert(!animation_scheduler_update(s));
+
+    for (i=0; i<n; i++) {
+        AnimationRunner* r;
+        xs[i] = -1.0;
+
+        if (i % 4 == 3) {
+            /* finishes on the first update */
+            r = animation_runner(scale(linearf1(&xs[i], 0.0, 1.0), 1e-6));
+        } else if (i % 2 == 0) {
+            /* all of these update the same counter, so they must conflict */
+            r = animation_runner(attach(scale(linearf1(&xs[i], 0.0, 1000.0), 1000.0), derive(count_updates, 1, &xs[i], &count)));
+        } else {
+            r = animation_runner(scale(linearf1(&xs[i], 0.0, 1000.0), 1000.0));
+        }
+
+        animation_runner_start(r);
+        animation_scheduler_add(s, r);
+
+        if (i % 2 == 0) {
+            if (previous != NULL)
+                animation_scheduler_conflict(s, previous, r);
+            previous = r;
+        }
+    }
+
+    for (i=0; i<3; i++)
+        g_assert(animation_scheduler_update(s));
+
+    g_assert_cmpint(count, ==, 3 * n / 2);
+    for (i=0; i<n; i++) {
+        if (i % 4 == 3)
+            assert_float_equal(xs[i], 1.0);
+        else
+            g_assert(xs[i] >= 0.0 && xs[i] < 10.0);
+    }
+
+    animation_scheduler_free(s);
+    free(xs);
+}
+
+void test_clock() {
+    float x, y;
+
+    AnimationClock* c = animation_clock_manual();
+    AnimationRunner* r1 = animation_runner_with_clock(linearf1(&x, 0.0, 1.0), c);
+    AnimationRunner* r2 = animation_runner_with_clock(scale(linearf1(&y, 0.0, 1.0), 2.0), c);
+
+    animation_clock_advance(c, 10.0);
+    animation_runner_start(r1);
+    animation_runner_start(r2);
+
+    animation_clock_advance(c, 0.5);
+    g_assert(animation_runner_update(r1)); assert_float_equal(x, 0.5);
+    g_assert(animation_runner_update(r2)); assert_float_equal(y, 0.25);
+
+    /* a manual clock does not move on its own */
+    animation_clock_tick(c);
+    g_assert(animation_runner_update(r1)); assert_float_equal(x, 0.5);
+
+    animation_clock_advance(c, 1.0);
+    g_assert(!animation_runner_update(r1)); assert_float_equal(x, 1.0);
+    g_assert(animation_runner_update(r2));  assert_float_equal(y, 0.75);
+
+    animation_runner_free(r1);
+    animation_runner_free(r2);
+    animation_clock_free(c);
+
+    /* milliseconds still count days after boot, where the monotonic time may be */
+    c = animation_clock_manual();
+    animation_clock_advance(c, 1e6);
+    animation_clock_advance(c, 1e-3);
+    g_assert_cmpfloat(fabs(animation_clock_time(c) - 1e6 - 1e-3), <, 1e-9);
+    animation_clock_free(c);
+}
+
+void test_clock_fixed() {
+    float x;
+    int ticks = 0;
+
+    AnimationClock* c = animation_clock_fixed(0.25);
+    AnimationRunner* r = animation_runner_with_clock(scale(linearf1(&x, 0.0, 1.0), 2.0), c);
+    animation_runner_start(r);
+
+    do {
+        animation_clock_tick(c);
+        ticks++;
+        g_assert_cmpfloat(animation_clock_time(c), ==, ticks * 0.25);
+    } while (animation_runner_update(r));
+
+    g_assert_cmpint(ticks, ==, 8);
+    assert_float_equal(x, 1.0);
+
+    animation_runner_free(r);
+    animation_clock_free(c);
+}
+
+void count_completions(AnimationRunner* r, void* data) {
+    int* count = data;
+    *count = *count + 1;
+}
+
+void test_timeline() {
+    int i, n = 1000, done = 0;
+    float* xs = malloc(sizeof(float) * n);
+
+    AnimationClock* c = animation_clock_manual();
+    AnimationTimeline* tl = animation_timeline_new(c);
+
+    /* runner i starts at i/10 and lasts 1 */
+    for (i=n-1; i>=0; i--) {
+        xs[i] = -1.0;
+        animation_timeline_add(tl, animation_runner(linearf1(&xs[i], 0.0, 1.0)), i / 10.0, count_completions, &done);
+    }
+
+    animation_clock_advance(c, 2.05);
+    g_assert(animation_timeline_update(tl));
+    g_assert_cmpint(done, ==, 11);
+    assert_float_equal(xs[0], 1.0);
+    g_assert_cmpfloat(fabs(xs[15] - 0.55), <, 1e-4);
+    g_assert_cmpfloat(fabs(xs[20] - 0.05), <, 1e-4);
+    assert_float_equal(xs[21], -1.0);
+
+    while (animation_timeline_update(tl))
+        animation_clock_advance(c, 0.5);
+
+    g_assert_cmpint(done, ==, n);
+    for (i=0; i<n; i++)
+        assert_float_equal(xs[i], 1.0);
+
+    animation_timeline_free(tl);
+    animation_clock_free(c);
+    free(xs);
+}
+
+void test_tween_pool() {
+    int i, n = 1003;
+    float t, *xs = malloc(sizeof(float) * n), *ys = malloc(sizeof(float) * n);
+    Animation** as = malloc(sizeof(Animation*) * n);
+    AnimationTweenPool* p = animation_tween_pool_new();
+
+    /* tween i starts at i/1000 and lasts 1 + (i % 5) / 2, each easing in turn */
+    for (i=0; i<n; i++) {
+        float d = 1.0 + (i % 5) / 2.0;
+        Animation* a = scale(linearf1(&ys[i], i, -i), d);
+        AnimationEasing easing = i % 4;
+
+        xs[i] = ys[i] = -1.0;
+        as[i] = (easing == TWEEN_SINUSOID) ? sinusoid(a) : (easing == TWEEN_LINEAR) ? a : exponent(a, easing);
+        g_assert_cmpint(animation_tween_pool_add(p, &xs[i], i, -i, d, i / 1000.0, easing), ==, i);
+    }
+
+    animation_tween_pool_remove(p, 7);
+    g_assert_cmpint(animation_tween_pool_size(p), ==, n-1);
+    g_assert_cmpint(animation_tween_pool_add(p, &xs[7], 7, -7, 1.0 + 7 % 5 / 2.0, 7 / 1000.0, 7 % 4), ==, 7);
+
+    /* tweens that have not started leave their targets alone */
+    g_assert(animation_tween_pool_update(p, 0.25));
+    assert_float_equal(xs[251], -1.0);
+
+    for (t=0.25; animation_tween_pool_update(p, t); t+=0.25)
+        for (i=0; i<n && i / 1000.0 <= t; i++) {
+            float local = t - i / 1000.0, d = animation_duration(as[i]);
+            animation_update(as[i], (local < d) ? local : d);
+            g_assert_cmpfloat(fabs(xs[i] - ys[i]), <, 1e-3);
+        }
+    g_assert_cmpfloat(t, >, 3.0);
+    g_assert_cmpint(animation_tween_pool_size(p), ==, 0);
+
+    for (i=0; i<n; i++)
+        animation_free(as[i]);
+    animation_tween_pool_free(p);
+    free(as);
+    free(xs);
+    free(ys);
+}
+
+void test_static() {
+    float x, y, z;
+    int count = 0;
+
+    /* unsealed, a hold writes on every update, so it restores a value written between updates */
+    Animation* h = sequence(linearf1(&x, 0.0, 1.0), holdf1(&x, 5.0));
+    animation_update(h, 1.5); assert_float_equal(x, 5.0);
+    x = -1.0;
+    animation_update(h, 1.75); assert_float_equal(x, 5.0);
+
+    /* sealed, it writes once and is skipped after, so such a value persists until the hold is switched to again */
+    animation_seal(h);
+    animation_update(h, 1.5); assert_float_equal(x, 5.0);
+    x = -1.0;
+    animation_update(h, 1.75); assert_float_equal(x, -1.0);
+    animation_update(h, 0.5);
+    animation_update(h, 1.5); assert_float_equal(x, 5.0);
+    animation_free(h);
+
+    /* the rest are sealed, so that static nodes are skipped */
+
+    /* a held value is written once, but derived values with unknown inputs are computed on every update */
+    Animation* a = parallel(scale(linearf1(&y, 0.0, 1.0), 3.0),
+                            attach(pad_to(delay(linearf1(&x, 2.0, 2.0), 1.0), 3.0), derive(count_updates, 1, &x, &count)));
+    animation_seal(a);
+
+    animation_update(a, 0.5); assert_float_equal(y, 0.5 / 3.0); g_assert_cmpint(count, ==, 1);
+    animation_update(a, 1.5); assert_float_equal(x, 2.0); g_assert_cmpint(count, ==, 2);
+    animation_update(a, 2.5); assert_float_equal(y, 2.5 / 3.0); assert_float_equal(x, 2.0); g_assert_cmpint(count, ==, 3);
+    animation_free(a);
+
+    /* a held value that a sibling also writes is written on every update, whichever comes last */
+    Animation* p1 = parallel(linearf1(&x, 0.0, 1.0), holdf1(&x, 5.0));
+    Animation* p2 = parallel(holdf1(&y, 5.0), linearf1(&y, 0.0, 1.0));
+    animation_seal(p1);
+    animation_seal(p2);
+    for (z=0.25; z<1.0; z+=0.25) {
+        animation_update(p1, z); assert_float_equal(x, 5.0);
+        animation_update(p2, z); assert_float_equal(y, z);
+    }
+    animation_free(p1);
+    animation_free(p2);
+
+    /* derived values attached to padding still run, each time their inputs change */
+    Animation* d = sequence(linearf1(&x, 0.0, 1.0), attach(scale(null_animation(), 2.0), deriveff(twice, &x, &y)));
+    animation_seal(d);
+    y = -1.0;
+    animation_update(d, 1.0); assert_float_equal(y, -1.0);
+    animation_update(d, 2.0); assert_float_equal(y, 2.0);
+    animation_update(d, 0.5);
+    animation_update(d, 2.5); assert_float_equal(y, 1.0);
+    animation_free(d);
+
+    /* switching back to a static child of a sequence writes its values again */
+    Animation* b = sequencen(linearf1(&z, 0.0, 1.0), linearf1(&z, 5.0, 5.0), linearf1(&z, 1.0, 0.0), NULL);
+    animation_seal(b);
+    animation_update(b, 1.5); assert_float_equal(z, 5.0);
+    animation_update(b, 2.5); assert_float_equal(z, 0.5);
+    animation_update(b, 1.5); assert_float_equal(z, 5.0);
+    animation_update(b, 0.5); assert_float_equal(z, 0.5);
+    animation_update(b, 1.25); assert_float_equal(z, 5.0);
+    animation_free(b);
+
+    Animation* c = sequence(linearf1(&z, 0.0, 1.0), parallel(linearf1(&z, 7.0, 7.0), linearf1(&x, 0.0, 1.0)));
+    animation_seal(c);
+    animation_update(c, 1.5); assert_float_equal(z, 7.0); assert_float_equal(x, 0.5);
+    animation_update(c, 0.5); assert_float_equal(z, 0.5);
+    animation_update(c, 1.75); assert_float_equal(z, 7.0); assert_float_equal(x, 0.75);
+    animation_free(c);
+
+    /* a sealed subtree's hold is written again on every update when an unsealed sibling writes the same value */
+    Animation* s = sequence(linearf1(&z, 0.0, 1.0), holdf1(&z, 3.0));
+    animation_seal(s);
+    Animation* u = parallel(scale(linearf1(&z, 0.0, 1.0), 2.0), s);
+    animation_update(u, 1.5); assert_float_equal(z, 3.0);
+    animation_update(u, 1.75); assert_float_equal(z, 3.0);
+    animation_free(u);
+}
+
+int counted_twice_calls = 0;
+
+float counted_twice(float f) {
+    counted_twice_calls++;
+    return f * 2;
+}
+
+float add_one(float f) {
+    return f + 1;
+}
+
+void test_derived_graph() {
+    float x, y, a, b, c, d;
+
+    /* attached out of order: c = b + 1 = 2a + 1 = 4x + 1 */
+    Animation* an = attachn(parallel(linearf1(&x, 0.0, 1.0), linearf1(&y, 3.0, 3.0)),
+                            deriveff(add_one, &b, &c), deriveff(twice, &a, &b), deriveff(twice, &x, &a), deriveff(counted_twice, &y, &d), NULL);
+
+    animation_update(an, 0.5); assert_float_equal(a, 1.0); assert_float_equal(b, 2.0); assert_float_equal(c, 3.0); assert_float_equal(d, 6.0);
+    animation_update(an, 0.25); assert_float_equal(c, 2.0);
+    animation_update(an, 1.0); assert_float_equal(c, 5.0);
+
+    /* y never changes, so d is computed once */
+    g_assert_cmpint(counted_twice_calls, ==, 1);
+
+    animation_free(an);
+}
+
+void test_transformv() {
+    int i, n = 1001;
+    float* in = malloc(sizeof(float) * n);
+    float* out = malloc(sizeof(float) * n);
+    int* ints = malloc(sizeof(int) * n);
+
+    for (i=0; i<n; i++)
+        in[i] = (i - 500) * 0.173;
+
+    transformv_sin(in, out, n);
+    for (i=0; i<n; i++)
+        g_assert_cmpfloat(fabs(out[i] - sin(in[i])), <, 2e-6);
+
+    transformv_cos(in, out, n);
+    for (i=0; i<n; i++)
+        g_assert_cmpfloat(fabs(out[i] - cos(in[i])), <, 2e-6);
+
+    for (i=0; i<n; i++)
+        in[i] = (i - 500) * 0.25;
+    transformv_round(in, out, n);
+    for (i=0; i<n; i++)
+        assert_float_equal(out[i], (in[i] < 0) ? -floor(-in[i] + 0.5) : floor(in[i] + 0.5));
+
+    transformv_ftoi(in, ints, n);
+    for (i=0; i<n; i++)
+        g_assert_cmpint(ints[i], ==, (int)in[i]);
+
+    transformv_itof(ints, out, n);
+    for (i=0; i<n; i++)
+        assert_float_equal(out[i], ints[i]);
+
+    free(in);
+    free(out);
+    free(ints);
+}
+
+/* the vector kernels work in groups and leave the tail to the scalar kernel, so an argument placed both in a group and
+ * in the tail compares the two.  arguments too large to reduce, infinities and NaN must agree bit for bit */
+void test_transformv_edges() {
+    float nan = HUGE_VAL - HUGE_VAL;
+    float special[] = { 8192.0, 8192.5, -3e5, 1e30, HUGE_VAL, -HUGE_VAL, nan, 2147483520.0, 2147483648.0, -2147483648.0, -4e9, 4e9 };
+    int i, k, n = 17, ints[17];
+    float in[17], out[17];
+
+    for (k=0; k<sizeof(special) / sizeof(float); k++) {
+        float x = special[k];
+        for (i=0; i<n; i++)
+            in[i] = 0.5;
+        in[3] = in[n-1] = x;
+
+        transformv_sin(in, out, n);
+        g_assert(memcmp(&out[3], &out[n-1], sizeof(float)) == 0);
+        g_assert(fabs(out[3] - sin(x)) < 2e-6 || (out[3] != out[3] && x - x != 0.0));
+        g_assert_cmpfloat(fabs(out[0] - sin(0.5)), <, 2e-6);
+
+        transformv_cos(in, out, n);
+        g_assert(memcmp(&out[3], &out[n-1], sizeof(float)) == 0);
+        g_assert(fabs(out[3] - cos(x)) < 2e-6 || (out[3] != out[3] && x - x != 0.0));
+
+        transformv_ftoi(in, ints, n);
+        g_assert_cmpint(ints[3], ==, ints[n-1]);
+        g_assert_cmpint(ints[3], ==, (x != x) ? 0 : (x >= 2147483648.0) ? G_MAXINT : (x <= -2147483648.0) ? G_MININT : (int)x);
+    }
+}
+
+void test_mapderive_builtin() {
+    float x[11], clamped[11], scaled[11];
+    float* start = malloc(sizeof(float) * 11);
+    float* end = malloc(sizeof(float) * 11);
+    int i;
+
+    for (i=0; i<11; i++) {
+        start[i] = -5.0;
+        end[i] = 5.0;
+    }
+
+    Animation* a = attachn(linearf(x, 11, start, end),
+                           mapderive_affine(11, clamped, scaled, 2.0, 1.0), mapderive_clamp(11, x, clamped, -1.0, 2.0), NULL);
+
+    animation_update(a, 1.0);
+    for (i=0; i<11; i++) {
+        assert_float_equal(clamped[i], 2.0);
+        assert_float_equal(scaled[i], 5.0);
+    }
+
+    animation_update(a, 0.55);
+    for (i=0; i<11; i++) {
+        assert_float_equal(clamped[i], 0.5);
+        assert_float_equal(scaled[i], 2.0);
+    }
+
+    animation_free(a);
+}
+
+void test_exp_fractional() {
+    float f, t;
+    Animation* a = exponent(linearf1(&f, 0.0, 1.0), 2.5);
+    Animation* b = exponent(linearf1(&f, 0.0, 1.0), 3.0);
+
+    for (t=0.0; t<=1.0; t+=0.0625) {
+        animation_update(a, t); g_assert_cmpfloat(fabs(f - pow(t, 2.5)), <, 1e-6);
+        animation_update(b, t); g_assert_cmpfloat(fabs(f - pow(t, 3.0)), <, 1e-6);
+    }
+
+    animation_free(a);
+    animation_free(b);
+}
+
+void test_lut() {
+    float f, g, t;
+    Animation* a = transform(linearf1(&f, 0.0, 1.0), lut_transform(sinusoid_transform(), 64));
+    Animation* b = sinusoid(linearf1(&g, 0.0, 1.0));
+
+    for (t=0.0; t<=1.0; t+=0.01) {
+        animation_update(a, t);
+        animation_update(b, t);
+        g_assert_cmpfloat(fabs(f - g), <, 2e-4);
+    }
+    animation_update(a, 1.0); assert_float_equal(f, 1.0);
+    animation_update(a, 0.5); assert_float_equal(f, 0.5);
+
+    animation_free(a);
+    animation_free(b);
+}
+
+void test_cubic_bezier() {
+    float f, t;
+
+    /* with its control points on the diagonal the curve is the identity */
+    Animation* a = transform(linearf1(&f, 0.0, 1.0), cubic_bezier_transform(1.0 / 3.0, 1.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0));
+    for (t=0.0; t<=1.0; t+=0.01) {
+        animation_update(a, t); g_assert_cmpfloat(fabs(f - t), <, 1e-5);
+    }
+    animation_free(a);
+
+    /* css ease */
+    Animation* b = transform(linearf1(&f, 0.0, 1.0), cubic_bezier_transform(0.25, 0.1, 0.25, 1.0));
+    animation_update(b, 0.0); assert_float_equal(f, 0.0);
+    animation_update(b, 0.5); g_assert_cmpfloat(fabs(f - 0.8024033877), <, 1e-5);
+    animation_update(b, 1.0); assert_float_equal(f, 1.0);
+    animation_free(b);
+
+    /* css ease-in is slow to start */
+    Animation* c = transform(linearf1(&f, 0.0, 1.0), cubic_bezier_transform(0.42, 0.0, 1.0, 1.0));
+    animation_update(c, 0.25); g_assert_cmpfloat(f, <, 0.1);
+    animation_update(c, 0.999); g_assert_cmpfloat(f, >, 0.99);
+    animation_free(c);
+}
+
 int main(int argc, char** argv) {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/libanim/animation/null", test_null);
@@ -243,18 +1537,61 @@ int main(int argc, char** argv) {
     g_test_add_func("/libanim/animation/linearf/one_dimension/2", test_linearf_one_dimension_range);
     g_test_add_func("/libanim/animation/linearf/three_dimensions/1", test_linearf_three_dimensions_unit);
     g_test_add_func("/libanim/animation/linearf/three_dimensions/2", test_linearf_three_dimensions_range);
+    g_test_add_func("/libanim/animation/linearf/wide", test_linearf_wide);
+    g_test_add_func("/libanim/animation/lineari/wide", test_lineari_wide);
     g_test_add_func("/libanim/animation/bezier/one_dimension/1", test_bezier_one_dimension_one);
     g_test_add_func("/libanim/animation/bezier/one_dimension/2", test_bezier_one_dimension_two);
     g_test_add_func("/libanim/animation/bezier/three_dimensions/1", test_bezier_three_dimension_one);
+    g_test_add_func("/libanim/animation/bezier/high_degree", test_bezier_high_degree);
+    g_test_add_func("/libanim/animation/spline/catmullrom", test_catmullrom);
+    g_test_add_func("/libanim/animation/spline/natural", test_naturalspline);
+    g_test_add_func("/libanim/animation/spline/bspline", test_bspline);
+    g_test_add_func("/libanim/animation/keyframes/modes", test_keyframes_modes);
+    g_test_add_func("/libanim/animation/keyframes/long", test_keyframes_long);
     g_test_add_func("/libanim/animation/sequence", test_sequence);
+    g_test_add_func("/libanim/animation/sequence/n", test_sequencen);
+    g_test_add_func("/libanim/animation/sequence/v", test_sequencev);
+    g_test_add_func("/libanim/animation/sequence/cursor", test_sequence_cursor);
     g_test_add_func("/libanim/animation/parallel", test_parallel);
     g_test_add_func("/libanim/animation/delay", test_delay);
     g_test_add_func("/libanim/animation/scale/1", test_scale_up);
     g_test_add_func("/libanim/animation/scale/2", test_scale_down);
+    g_test_add_func("/libanim/animation/duration", test_duration_cached);
     g_test_add_func("/libanim/transform/identity", test_identity);
     g_test_add_func("/libanim/transform/sinusoid", test_sinusoid);
     g_test_add_func("/libanim/transform/reverse", test_reverse);
     g_test_add_func("/libanim/transform/exp", test_exp);
+    g_test_add_func("/libanim/transform/exp_fractional", test_exp_fractional);
+    g_test_add_func("/libanim/transform/lut", test_lut);
+    g_test_add_func("/libanim/transform/cubic_bezier", test_cubic_bezier);
+    g_test_add_func("/libanim/compile", test_compile);
+    g_test_add_func("/libanim/optimize", test_optimize);
+    g_test_add_func("/libanim/sample_batch/1", test_sample_batch);
+    g_test_add_func("/libanim/sample_batch/2", test_sample_batch_derived);
+    g_test_add_func("/libanim/sample_batch/3", test_sample_batch_partial);
+    g_test_add_func("/libanim/bake/1", test_bake);
+    g_test_add_func("/libanim/bake/2", test_bake_error);
+    g_test_add_func("/libanim/instances", test_instances);
+    g_test_add_func("/libanim/image", test_image);
+    g_test_add_func("/libanim/image/corrupt", test_image_corrupt);
+    g_test_add_func("/libanim/stats", test_stats);
+    g_test_add_func("/libanim/arena/1", test_arena);
+    g_test_add_func("/libanim/arena/2", test_arena_mixed);
+    g_test_add_func("/libanim/arena/3", test_arena_push_twice);
+    g_test_add_func("/libanim/arena/4", test_arena_hold);
+    g_test_add_func("/libanim/arena/5", test_arena_aligned);
+    g_test_add_func("/libanim/seal", test_seal);
+    g_test_add_func("/libanim/seal/unsealed_parent", test_seal_unsealed_parent);
+    g_test_add_func("/libanim/scheduler", test_scheduler);
+    g_test_add_func("/libanim/clock/manual", test_clock);
+    g_test_add_func("/libanim/clock/fixed", test_clock_fixed);
+    g_test_add_func("/libanim/timeline", test_timeline);
+    g_test_add_func("/libanim/tween_pool", test_tween_pool);
+    g_test_add_func("/libanim/static", test_static);
+    g_test_add_func("/libanim/derived/graph", test_derived_graph);
+    g_test_add_func("/libanim/derived/transformv", test_transformv);
+    g_test_add_func("/libanim/derived/transformv/edges", test_transformv_edges);
+    g_test_add_func("/libanim/derived/builtin", test_mapderive_builtin);
     g_test_add_func("/libanim/scenario", scenario_one);
 	g_test_run();
 